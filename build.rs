@@ -5,11 +5,19 @@ use std::process::Command;
 fn main() {
     #[cfg(feature = "llvm")]
     {
-        Command::new("make")
+        let make = Command::new("make")
             .args(["-C", "stdlib"])
             .output()
             .expect("Could not build stdlib");
 
+        // The stdlib is built with clang, llvm-link and opt, see docs/installing.rst
+        if !make.status.success() {
+            panic!(
+                "Could not build stdlib; are clang, llvm-link and opt in the path?\n{}",
+                String::from_utf8_lossy(&make.stderr)
+            );
+        }
+
         // compile our linker
         let cxxflags = Command::new("llvm-config")
             .args(["--cxxflags"])
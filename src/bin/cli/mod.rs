@@ -13,7 +13,7 @@ use serde::Deserialize;
 use std::{ffi::OsString, path::PathBuf, process::exit};
 
 use solang::{
-    codegen::{OptimizationLevel, Options},
+    codegen::{OptimizationLevel, Options, DEFAULT_HEAP_SIZE, MAX_HEAP_SIZE},
     file_resolver::FileResolver,
     Target,
 };
@@ -194,6 +194,10 @@ impl Compile {
                     self.debug_features.generate_debug_info =
                         *matches.get_one::<bool>("GENERATEDEBUGINFORMATION").unwrap()
                 }
+                "STDLIBPROFILE" => {
+                    self.debug_features.stdlib_profile =
+                        *matches.get_one::<bool>("STDLIBPROFILE").unwrap()
+                }
                 "RELEASE" => {
                     self.debug_features.release = *matches.get_one::<bool>("RELEASE").unwrap()
                 }
@@ -221,6 +225,19 @@ impl Compile {
                         .unwrap()
                 }
                 "OPT" => self.optimizations.opt_level = matches.get_one::<String>("OPT").cloned(),
+                "ARENAHEAP" => {
+                    self.optimizations.arena_heap = *matches.get_one::<bool>("ARENAHEAP").unwrap()
+                }
+                "HEAPSIZE" => {
+                    self.optimizations.heap_size = matches.get_one::<u32>("HEAPSIZE").copied()
+                }
+                "MINSIZE" => {
+                    self.optimizations.min_size = *matches.get_one::<bool>("MINSIZE").unwrap()
+                }
+                "WASMBULKMEMORY" => {
+                    self.optimizations.wasm_bulk_memory =
+                        *matches.get_one::<bool>("WASMBULKMEMORY").unwrap()
+                }
 
                 "TARGET" => self.target_arg.name = matches.get_one::<String>("TARGET").cloned(),
                 "ADDRESS_LENGTH" => {
@@ -344,6 +361,10 @@ pub struct DebugFeatures {
     #[serde(default, rename(deserialize = "generate-debug-info"))]
     pub generate_debug_info: bool,
 
+    #[arg(name = "STDLIBPROFILE", help = "Log how often the stdlib helpers are called, how many bytes they process and how many loop iterations they take", long = "stdlib-profile", action = ArgAction::SetTrue)]
+    #[serde(default, rename(deserialize = "stdlib-profile"))]
+    pub stdlib_profile: bool,
+
     #[arg(name = "RELEASE", help = "Disable all debugging features such as prints, logging runtime errors, and logging api return codes", long = "release", action = ArgAction::SetTrue)]
     #[serde(default)]
     pub release: bool,
@@ -356,6 +377,7 @@ impl Default for DebugFeatures {
             log_runtime_errors: true,
             log_prints: true,
             generate_debug_info: false,
+            stdlib_profile: false,
             release: false,
         }
     }
@@ -390,6 +412,26 @@ pub struct Optimizations {
     #[serde(rename(deserialize = "llvm-IR-optimization-level"))]
     pub opt_level: Option<String>,
 
+    #[arg(name = "ARENAHEAP", help = "Use a heap which never frees memory, which is cheaper for short-lived Solana transactions", long = "arena-heap", action = ArgAction::SetTrue, display_order = 6)]
+    #[serde(default, rename(deserialize = "arena-heap"))]
+    pub arena_heap: bool,
+
+    #[arg(name = "HEAPSIZE", help = "Heap size in bytes on Solana, between 32KiB and 256KiB in multiples of 1KiB", long = "heap-size", num_args = 1, value_parser = ValueParser::new(parse_heap_size), display_order = 7)]
+    #[serde(
+        default,
+        rename(deserialize = "heap-size"),
+        deserialize_with = "deserialize_heap_size"
+    )]
+    pub heap_size: Option<u32>,
+
+    #[arg(name = "MINSIZE", help = "Link with the min-size profile, which removes unused and duplicate code and strips symbols", long = "min-size", action = ArgAction::SetTrue, display_order = 8)]
+    #[serde(default, rename(deserialize = "min-size"))]
+    pub min_size: bool,
+
+    #[arg(name = "WASMBULKMEMORY", help = "Copy and fill memory with the Wasm bulk memory instructions, which the chain must support", long = "wasm-bulk-memory", action = ArgAction::SetTrue, display_order = 9)]
+    #[serde(default, rename(deserialize = "wasm-bulk-memory"))]
+    pub wasm_bulk_memory: bool,
+
     #[cfg(feature = "wasm_opt")]
     #[arg(
         name = "WASM_OPT",
@@ -566,6 +608,11 @@ pub fn options_arg(debug: &DebugFeatures, optimizations: &Optimizations) -> Opti
         log_api_return_codes: debug.log_api_return_codes && !debug.release,
         log_runtime_errors: debug.log_runtime_errors && !debug.release,
         log_prints: debug.log_prints && !debug.release,
+        arena_heap: optimizations.arena_heap,
+        heap_size: optimizations.heap_size.unwrap_or(DEFAULT_HEAP_SIZE),
+        stdlib_profile: debug.stdlib_profile && !debug.release,
+        min_size: optimizations.min_size,
+        wasm_bulk_memory: optimizations.wasm_bulk_memory,
         #[cfg(feature = "wasm_opt")]
         wasm_opt: optimizations.wasm_opt_passes.or(if debug.release {
             Some(OptimizationPasses::Z)
@@ -586,6 +633,23 @@ fn parse_import_map(map: &str) -> Result<(String, PathBuf), String> {
     }
 }
 
+fn parse_heap_size(size: &str) -> Result<u32, String> {
+    check_heap_size(size.parse::<u32>().map_err(|err| err.to_string())?)
+}
+
+/// The heap frame requested by a Solana transaction must be a multiple of 1KiB
+fn check_heap_size(size: u32) -> Result<u32, String> {
+    if !(DEFAULT_HEAP_SIZE..=MAX_HEAP_SIZE).contains(&size) {
+        Err(format!(
+            "heap size must be between {DEFAULT_HEAP_SIZE} and {MAX_HEAP_SIZE}"
+        ))
+    } else if size % 1024 != 0 {
+        Err("heap size must be a multiple of 1024".to_owned())
+    } else {
+        Ok(size)
+    }
+}
+
 fn parse_version(version: &str) -> Result<String, String> {
     match Version::parse(version) {
         Ok(version) => Ok(version.to_string()),
@@ -638,6 +702,21 @@ where
     }
 }
 
+fn deserialize_heap_size<'de, D>(deserializer: D) -> Result<Option<u32>, D::Error>
+where
+    D: serde::Deserializer<'de>,
+{
+    let res: Option<u32> = Option::deserialize(deserializer)?;
+
+    match res {
+        Some(size) => match check_heap_size(size) {
+            Ok(size) => Ok(Some(size)),
+            Err(err) => Err(serde::de::Error::custom(err)),
+        },
+        None => Ok(None),
+    }
+}
+
 fn deserialize_emit<'de, D>(deserializer: D) -> Result<Option<String>, D::Error>
 where
     D: serde::Deserializer<'de>,
@@ -112,7 +112,11 @@ mod tests {
         strength-reduce = false
         vector-to-slice = false
         common-subexpression-elimination = true
-        llvm-IR-optimization-level = "aggressive"  # Set llvm optimizer level. Valid options are "none", "less", "default", "aggressive""#;
+        llvm-IR-optimization-level = "aggressive"  # Set llvm optimizer level. Valid options are "none", "less", "default", "aggressive"
+        arena-heap = true
+        heap-size = 102400
+        min-size = true
+        wasm-bulk-memory = true"#;
 
         let opt: cli::Optimizations = toml::from_str(opt_toml).unwrap();
 
@@ -122,6 +126,14 @@ mod tests {
         assert!(!opt.strength_reduce);
         assert!(!opt.vector_to_slice);
         assert_eq!(opt.opt_level.unwrap(), "aggressive");
+        assert!(opt.arena_heap);
+        assert_eq!(opt.heap_size, Some(102400));
+        assert!(opt.min_size);
+        assert!(opt.wasm_bulk_memory);
+
+        let opt: Result<cli::Optimizations, _> = toml::from_str("heap-size = 1000");
+
+        assert!(opt.is_err());
     }
 
     #[test]
@@ -196,6 +208,7 @@ mod tests {
                     log_runtime_errors: true,
                     log_prints: true,
                     generate_debug_info: false,
+                    stdlib_profile: false,
                     release: false
                 },
                 optimizations: cli::Optimizations {
@@ -205,13 +218,17 @@ mod tests {
                     vector_to_slice: true,
                     common_subexpression_elimination: true,
                     opt_level: Some("default".to_owned()),
+                    arena_heap: false,
+                    heap_size: None,
+                    min_size: false,
+                    wasm_bulk_memory: false,
                     #[cfg(feature = "wasm_opt")]
                     wasm_opt_passes: None
                 }
             }
         );
 
-        let command = "solang compile flipper.sol sesa.sol --config-file solang.toml --contract-authors not_sesa --target polkadot --value-length=31 --address-length=33 --no-dead-storage --no-constant-folding --no-strength-reduce --no-vector-to-slice --no-cse -O aggressive".split(' ');
+        let command = "solang compile flipper.sol sesa.sol --config-file solang.toml --contract-authors not_sesa --target polkadot --value-length=31 --address-length=33 --no-dead-storage --no-constant-folding --no-strength-reduce --no-vector-to-slice --no-cse -O aggressive --arena-heap --heap-size 65536 --min-size --wasm-bulk-memory --stdlib-profile".split(' ');
 
         let matches = Cli::command().get_matches_from(command);
 
@@ -251,6 +268,7 @@ mod tests {
                     log_runtime_errors: true,
                     log_prints: true,
                     generate_debug_info: false,
+                    stdlib_profile: true,
                     release: false
                 },
                 optimizations: cli::Optimizations {
@@ -260,6 +278,10 @@ mod tests {
                     vector_to_slice: false,
                     common_subexpression_elimination: false,
                     opt_level: Some("aggressive".to_owned()),
+                    arena_heap: true,
+                    heap_size: Some(65536),
+                    min_size: true,
+                    wasm_bulk_memory: true,
                     #[cfg(feature = "wasm_opt")]
                     wasm_opt_passes: None
                 }
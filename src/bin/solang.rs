@@ -34,6 +34,11 @@ mod idl;
 mod languageserver;
 
 fn main() {
+    // The compiler runs itself to do the links in separate processes
+    if let Some(status) = solang::link_worker(&std::env::args_os().collect::<Vec<_>>()) {
+        exit(status);
+    }
+
     let matches = Cli::command().get_matches();
 
     let cli = Cli::from_arg_matches(&matches).unwrap();
@@ -56,6 +61,10 @@ fn main() {
             } else {
                 compile_args
             };
+            if let Ok(program) = std::env::current_exe() {
+                solang::set_link_worker(program);
+            }
+
             compile(&config)
         }
         Commands::ShellComplete(shell_args) => shell_complete(Cli::command(), shell_args),
@@ -172,6 +181,22 @@ fn compile(compile_args: &Compile) {
 
     let opt = options_arg(&compile_args.debug_features, &compile_args.optimizations);
 
+    if opt.arena_heap && target != Target::Solana {
+        eprintln!("warning: the `arena-heap` flag will be ignored for {target} target");
+    }
+
+    if compile_args.optimizations.heap_size.is_some() && target != Target::Solana {
+        eprintln!("warning: the `heap-size` flag will be ignored for {target} target");
+    }
+
+    if opt.stdlib_profile && target == Target::EVM {
+        eprintln!("warning: the `stdlib-profile` flag will be ignored for {target} target");
+    }
+
+    if opt.wasm_bulk_memory && !target.is_polkadot() {
+        eprintln!("warning: the `wasm-bulk-memory` flag will be ignored for {target} target");
+    }
+
     let mut namespaces = Vec::new();
 
     let mut errors = false;
@@ -409,6 +434,15 @@ fn contract_results(
 
     let code = binary.code(Generate::Linked).expect("llvm build");
 
+    if verbose {
+        for (section, size) in binary.section_sizes(&code) {
+            eprintln!(
+                "info: section {section} of contract {} is {size} bytes",
+                resolved_contract.name
+            );
+        }
+    }
+
     #[cfg(feature = "wasm_opt")]
     if let Some(level) = opt.wasm_opt.filter(|_| ns.target.is_polkadot() && verbose) {
         eprintln!(
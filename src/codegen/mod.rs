@@ -84,6 +84,12 @@ impl From<inkwell::OptimizationLevel> for OptimizationLevel {
     }
 }
 
+/// The default heap size on Solana. Larger heaps must be requested by the transaction.
+pub const DEFAULT_HEAP_SIZE: u32 = 32 * 1024;
+
+/// The largest heap frame a Solana transaction can request
+pub const MAX_HEAP_SIZE: u32 = 256 * 1024;
+
 #[derive(Clone, Debug, PartialEq)]
 pub struct Options {
     pub dead_storage: bool,
@@ -96,6 +102,16 @@ pub struct Options {
     pub log_api_return_codes: bool,
     pub log_runtime_errors: bool,
     pub log_prints: bool,
+    /// Use the arena heap on Solana, where memory is never freed
+    pub arena_heap: bool,
+    /// Size of the heap on Solana in bytes
+    pub heap_size: u32,
+    /// Link the profiling build of the stdlib, which logs how often its helpers are called
+    pub stdlib_profile: bool,
+    /// Link with the min-size profile, which removes unused and duplicate code and strips symbols
+    pub min_size: bool,
+    /// Use the memory.copy and memory.fill instructions on Polkadot, for chains which support bulk memory
+    pub wasm_bulk_memory: bool,
     #[cfg(feature = "wasm_opt")]
     pub wasm_opt: Option<OptimizationPasses>,
 }
@@ -113,6 +129,11 @@ impl Default for Options {
             log_api_return_codes: false,
             log_runtime_errors: false,
             log_prints: true,
+            arena_heap: false,
+            heap_size: DEFAULT_HEAP_SIZE,
+            stdlib_profile: false,
+            min_size: false,
+            wasm_bulk_memory: false,
             #[cfg(feature = "wasm_opt")]
             wasm_opt: None,
         }
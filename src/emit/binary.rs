@@ -14,12 +14,12 @@ use std::collections::HashMap;
 #[cfg(feature = "wasm_opt")]
 use tempfile::tempdir;
 #[cfg(feature = "wasm_opt")]
-use wasm_opt::OptimizationOptions;
+use wasm_opt::{Feature, OptimizationOptions};
 
 use crate::codegen::{cfg::ReturnCode, Options};
 use crate::emit::{polkadot, TargetRuntime};
 use crate::emit::{solana, BinaryOp, Generate};
-use crate::linker::link;
+use crate::linker::{link, section_sizes};
 use crate::Target;
 use inkwell::builder::Builder;
 use inkwell::context::Context;
@@ -74,7 +74,7 @@ impl<'a> Binary<'a> {
         ns: &'a Namespace,
         opt: &'a Options,
     ) -> Self {
-        let std_lib = load_stdlib(context, &ns.target);
+        let std_lib = load_stdlib(context, &ns.target, opt);
         match ns.target {
             Target::Polkadot { .. } => {
                 polkadot::PolkadotTarget::build(context, &std_lib, contract, ns, opt)
@@ -84,6 +84,11 @@ impl<'a> Binary<'a> {
         }
     }
 
+    /// Return the name and size in bytes of each section of the linked code
+    pub fn section_sizes(&self, code: &[u8]) -> Vec<(String, usize)> {
+        section_sizes(code, self.target)
+    }
+
     /// Compile the bin and return the code as bytes. The result is
     /// cached, since this function can be called multiple times (e.g. one for
     /// each time a bin of this type is created).
@@ -108,13 +113,49 @@ impl<'a> Binary<'a> {
             _ => {}
         }
 
+        // Fold functions with identical code. Unlike identical code folding in the linker, this
+        // knows which functions have their address taken; those become a call to the function
+        // they are folded into, so that function pointers still compare as expected.
+        if self.options.min_size {
+            let pass_manager = PassManager::create(());
+
+            pass_manager.add_merge_functions_pass();
+
+            pass_manager.run_on(&self.module);
+        }
+
+        // The linker can only remove whole sections, so for the min-size profile give
+        // each function and constant its own section. This is always done for wasm.
+        if self.options.min_size && self.target == Target::Solana {
+            for function in self.module.get_functions() {
+                let global = function.as_global_value();
+
+                if function.count_basic_blocks() > 0 && global.get_section().is_none() {
+                    let section = format!(".text.{}", global.get_name().to_string_lossy());
+
+                    global.set_section(Some(&section));
+                }
+            }
+
+            for global in self.module.get_globals() {
+                if global.is_constant()
+                    && global.get_initializer().is_some()
+                    && global.get_section().is_none()
+                {
+                    let section = format!(".rodata.{}", global.get_name().to_string_lossy());
+
+                    global.set_section(Some(&section));
+                }
+            }
+        }
+
         let target = inkwell::targets::Target::from_name(self.target.llvm_target_name()).unwrap();
 
         let target_machine = target
             .create_target_machine(
                 &self.target.llvm_target_triple(),
                 "",
-                self.target.llvm_features(),
+                self.target.llvm_features(self.options),
                 self.options.opt_level.into(),
                 RelocMode::Default,
                 CodeModel::Default,
@@ -134,7 +175,7 @@ impl<'a> Binary<'a> {
                 let slice = out.as_slice();
 
                 if generate == Generate::Linked {
-                    link(slice, &self.name, self.target).to_vec()
+                    link(slice, &self.name, self.target, self.options.min_size).to_vec()
                 } else {
                     slice.to_vec()
                 }
@@ -150,10 +191,18 @@ impl<'a> Binary<'a> {
 
             // Using the same config as cargo contract:
             // https://github.com/paritytech/cargo-contract/blob/71a8a42096e2df36d54a695d099aecfb1e394b78/crates/build/src/wasm_opt.rs#L67
-            OptimizationOptions::from(level)
+            let mut wasm_opt = OptimizationOptions::from(level);
+
+            wasm_opt
                 .mvp_features_only()
                 .zero_filled_memory(true)
-                .debug_info(self.options.generate_debug_information)
+                .debug_info(self.options.generate_debug_information);
+
+            if self.options.wasm_bulk_memory {
+                wasm_opt.enable_feature(Feature::BulkMemory);
+            }
+
+            wasm_opt
                 .run(&infile, &outfile)
                 .map_err(|err| format!("wasm-opt for binary {} failed: {}", self.name, err))?;
 
@@ -1112,62 +1161,53 @@ impl<'a> Binary<'a> {
 }
 
 /// Return the stdlib as parsed llvm module. The solidity standard library is hardcoded into
-/// the solang library
-fn load_stdlib<'a>(context: &'a Context, target: &Target) -> Module<'a> {
-    if *target == Target::Solana {
-        let memory = MemoryBuffer::create_from_memory_range(BPF_IR[0], "bpf_bc");
-
-        let module = Module::parse_bitcode_from_buffer(&memory, context).unwrap();
-
-        for bc in BPF_IR.iter().skip(1) {
-            let memory = MemoryBuffer::create_from_memory_range(bc, "bpf_bc");
-
-            module
-                .link_in_module(Module::parse_bitcode_from_buffer(&memory, context).unwrap())
-                .unwrap();
-        }
-
-        return module;
-    }
-
-    let memory = MemoryBuffer::create_from_memory_range(WASM_IR[0], "wasm_bc");
-
-    let module = Module::parse_bitcode_from_buffer(&memory, context).unwrap();
-
-    for bc in WASM_IR.iter().skip(1) {
-        let memory = MemoryBuffer::create_from_memory_range(bc, "wasm_bc");
-
-        module
-            .link_in_module(Module::parse_bitcode_from_buffer(&memory, context).unwrap())
-            .unwrap();
-    }
-
-    if let Target::Polkadot { .. } = *target {
-        // contracts pallet does not provide ripemd160
-        let memory = MemoryBuffer::create_from_memory_range(RIPEMD160_IR, "ripemd160");
-
-        module
-            .link_in_module(Module::parse_bitcode_from_buffer(&memory, context).unwrap())
-            .unwrap();
-    }
-
-    module
+/// the solang library. stdlib/Makefile links and optimizes the stdlib for each target into
+/// a single module, so this is one parse and no linking.
+fn load_stdlib<'a>(context: &'a Context, target: &Target, opt: &Options) -> Module<'a> {
+    let (bc, name) = match target {
+        Target::Solana => match (opt.arena_heap, opt.stdlib_profile) {
+            (false, false) => (SOLANA_STDLIB_IR, "solana_stdlib"),
+            (true, false) => (SOLANA_ARENA_STDLIB_IR, "solana_arena_stdlib"),
+            (false, true) => (SOLANA_PROFILE_STDLIB_IR, "solana_profile_stdlib"),
+            (true, true) => (
+                SOLANA_ARENA_PROFILE_STDLIB_IR,
+                "solana_arena_profile_stdlib",
+            ),
+        },
+        _ => match (opt.wasm_bulk_memory, opt.stdlib_profile) {
+            (false, false) => (POLKADOT_STDLIB_IR, "polkadot_stdlib"),
+            (true, false) => (
+                POLKADOT_BULK_MEMORY_STDLIB_IR,
+                "polkadot_bulk_memory_stdlib",
+            ),
+            (false, true) => (POLKADOT_PROFILE_STDLIB_IR, "polkadot_profile_stdlib"),
+            (true, true) => (
+                POLKADOT_BULK_MEMORY_PROFILE_STDLIB_IR,
+                "polkadot_bulk_memory_profile_stdlib",
+            ),
+        },
+    };
+
+    let memory = MemoryBuffer::create_from_memory_range(bc, name);
+
+    Module::parse_bitcode_from_buffer(&memory, context).unwrap()
 }
 
-static BPF_IR: [&[u8]; 6] = [
-    include_bytes!("../../target/bpf/stdlib.bc"),
-    include_bytes!("../../target/bpf/bigint.bc"),
-    include_bytes!("../../target/bpf/format.bc"),
-    include_bytes!("../../target/bpf/solana.bc"),
-    include_bytes!("../../target/bpf/ripemd160.bc"),
-    include_bytes!("../../target/bpf/heap.bc"),
-];
-
-static WASM_IR: [&[u8]; 4] = [
-    include_bytes!("../../target/wasm/stdlib.bc"),
-    include_bytes!("../../target/wasm/heap.bc"),
-    include_bytes!("../../target/wasm/bigint.bc"),
-    include_bytes!("../../target/wasm/format.bc"),
-];
-
-static RIPEMD160_IR: &[u8] = include_bytes!("../../target/wasm/ripemd160.bc");
+static SOLANA_STDLIB_IR: &[u8] = include_bytes!("../../target/bpf/solana-stdlib.bc");
+static SOLANA_ARENA_STDLIB_IR: &[u8] = include_bytes!("../../target/bpf/solana-stdlib-arena.bc");
+// Built with -DSTDLIB_PROFILE, which counts calls to the helpers and logs them at the end
+static SOLANA_PROFILE_STDLIB_IR: &[u8] =
+    include_bytes!("../../target/bpf/solana-stdlib-profile.bc");
+static SOLANA_ARENA_PROFILE_STDLIB_IR: &[u8] =
+    include_bytes!("../../target/bpf/solana-stdlib-arena-profile.bc");
+
+// The contracts pallet does not provide ripemd160, so this includes it
+static POLKADOT_STDLIB_IR: &[u8] = include_bytes!("../../target/wasm/polkadot-stdlib.bc");
+// Built with -mbulk-memory, so copying and filling memory are single instructions
+static POLKADOT_BULK_MEMORY_STDLIB_IR: &[u8] =
+    include_bytes!("../../target/wasm/polkadot-stdlib-bulk-memory.bc");
+// Built with -DSTDLIB_PROFILE; the generated code writes the counters to the debug buffer
+static POLKADOT_PROFILE_STDLIB_IR: &[u8] =
+    include_bytes!("../../target/wasm/polkadot-stdlib-profile.bc");
+static POLKADOT_BULK_MEMORY_PROFILE_STDLIB_IR: &[u8] =
+    include_bytes!("../../target/wasm/polkadot-stdlib-bulk-memory-profile.bc");
@@ -1,13 +1,13 @@
 // SPDX-License-Identifier: Apache-2.0
 
-use crate::codegen::cfg::{HashTy, ReturnCode};
+use crate::codegen::cfg::HashTy;
 use crate::codegen::revert::PanicCode;
 use crate::codegen::{Builtin, Expression};
 use crate::emit::binary::Binary;
 use crate::emit::math::{build_binary_op_with_overflow_check, multiply, power};
 use crate::emit::strings::{format_string, string_location};
 use crate::emit::{BinaryOp, TargetRuntime, Variable};
-use crate::sema::ast::{Namespace, RetrieveType, StructType, Type};
+use crate::sema::ast::{Namespace, RetrieveType, StringLocation, StructType, Type};
 use crate::Target;
 use inkwell::module::Linkage;
 use inkwell::types::{BasicType, StringRadix};
@@ -1529,18 +1529,62 @@ pub(super) fn expression<'a, T: TargetRuntime<'a> + ?Sized>(
                 .unwrap()
         }
         Expression::StringConcat { left, right, .. } => {
-            let (left, left_len) = string_location(target, bin, left, vartab, function, ns);
-            let (right, right_len) = string_location(target, bin, right, vartab, function, ns);
+            let mut pieces = Vec::new();
 
-            bin.builder
-                .build_call(
-                    bin.module.get_function("concat").unwrap(),
-                    &[left.into(), left_len.into(), right.into(), right_len.into()],
-                    "",
-                )
-                .try_as_basic_value()
-                .left()
-                .unwrap()
+            string_concat_pieces(left, &mut pieces);
+            string_concat_pieces(right, &mut pieces);
+
+            let pieces: Vec<_> = pieces
+                .into_iter()
+                .map(|piece| string_location(target, bin, piece, vartab, function, ns))
+                .collect();
+
+            if let [(left, left_len), (right, right_len)] = pieces.as_slice() {
+                bin.builder
+                    .build_call(
+                        bin.module.get_function("concat").unwrap(),
+                        &[
+                            (*left).into(),
+                            (*left_len).into(),
+                            (*right).into(),
+                            (*right_len).into(),
+                        ],
+                        "",
+                    )
+                    .try_as_basic_value()
+                    .left()
+                    .unwrap()
+            } else {
+                // For a + b + c, allocate the result once and copy each piece into it, rather
+                // than allocating an intermediate for each +
+                let size = pieces
+                    .iter()
+                    .map(|(_, len)| *len)
+                    .reduce(|size, len| bin.builder.build_int_add(size, len, "size"))
+                    .unwrap();
+
+                let v = bin
+                    .builder
+                    .build_call(
+                        bin.module.get_function("vector_reserve").unwrap(),
+                        &[size.into()],
+                        "",
+                    )
+                    .try_as_basic_value()
+                    .left()
+                    .unwrap();
+
+                // there is room for all the pieces, so the vector does not move
+                for (data, len) in pieces {
+                    bin.builder.build_call(
+                        bin.module.get_function("vector_append").unwrap(),
+                        &[v.into(), data.into(), len.into()],
+                        "",
+                    );
+                }
+
+                v
+            }
         }
         Expression::ReturnData { .. } => target.return_data(bin, function).into(),
         Expression::StorageArrayLength { array, elem_ty, .. } => {
@@ -1572,180 +1616,39 @@ pub(super) fn expression<'a, T: TargetRuntime<'a> + ?Sized>(
             bin.builder.build_load(selector_type, selector, "selector")
         }
         Expression::Builtin {
-            kind: Builtin::AddMod,
+            kind: kind @ (Builtin::AddMod | Builtin::MulMod),
             args,
             ..
         } => {
-            let arith_ty = bin.context.custom_width_int_type(512);
-            let res_ty = bin.context.custom_width_int_type(256);
+            let arith_ty = bin.context.custom_width_int_type(256);
 
             let x = expression(target, bin, &args[0], vartab, function, ns).into_int_value();
             let y = expression(target, bin, &args[1], vartab, function, ns).into_int_value();
             let k = expression(target, bin, &args[2], vartab, function, ns).into_int_value();
-            let dividend = bin.builder.build_int_add(
-                bin.builder.build_int_z_extend(x, arith_ty, "wide_x"),
-                bin.builder.build_int_z_extend(y, arith_ty, "wide_y"),
-                "x_plus_y",
-            );
-
-            let divisor = bin.builder.build_int_z_extend(k, arith_ty, "wide_k");
-
-            let pdividend = bin.build_alloca(function, arith_ty, "dividend");
-            let pdivisor = bin.build_alloca(function, arith_ty, "divisor");
-            let rem = bin.build_alloca(function, arith_ty, "remainder");
-            let quotient = bin.build_alloca(function, arith_ty, "quotient");
-
-            bin.builder.build_store(pdividend, dividend);
-            bin.builder.build_store(pdivisor, divisor);
-
-            let ret = bin
-                .builder
-                .build_call(
-                    bin.module.get_function("udivmod512").unwrap(),
-                    &[
-                        pdividend.into(),
-                        pdivisor.into(),
-                        rem.into(),
-                        quotient.into(),
-                    ],
-                    "quotient",
-                )
-                .try_as_basic_value()
-                .left()
-                .unwrap()
-                .into_int_value();
-
-            let success = bin.builder.build_int_compare(
-                IntPredicate::EQ,
-                ret,
-                bin.context.i32_type().const_zero(),
-                "success",
-            );
-
-            let success_block = bin.context.append_basic_block(function, "success");
-            let bail_block = bin.context.append_basic_block(function, "bail");
-            bin.builder
-                .build_conditional_branch(success, success_block, bail_block);
 
-            bin.builder.position_at_end(bail_block);
+            let x_m = bin.build_alloca(function, arith_ty, "x");
+            let y_m = bin.build_alloca(function, arith_ty, "y");
+            let k_m = bin.build_alloca(function, arith_ty, "k");
+            let out = bin.build_alloca(function, arith_ty, "out");
 
-            // On Solana the return type is 64 bit
-            let ret: BasicValueEnum = bin
-                .builder
-                .build_int_z_extend(
-                    ret,
-                    bin.return_values[&ReturnCode::Success].get_type(),
-                    "ret",
-                )
-                .into();
-
-            bin.builder.build_return(Some(&ret));
-            bin.builder.position_at_end(success_block);
-
-            let remainder = bin
-                .builder
-                .build_load(arith_ty, rem, "remainder")
-                .into_int_value();
-
-            bin.builder
-                .build_int_truncate(remainder, res_ty, "quotient")
-                .into()
-        }
-        Expression::Builtin {
-            kind: Builtin::MulMod,
-            args,
-            ..
-        } => {
-            let arith_ty = bin.context.custom_width_int_type(512);
-            let res_ty = bin.context.custom_width_int_type(256);
-
-            let x = expression(target, bin, &args[0], vartab, function, ns).into_int_value();
-            let y = expression(target, bin, &args[1], vartab, function, ns).into_int_value();
-            let x_m = bin.build_alloca(function, arith_ty, "x_m");
-            let y_m = bin.build_alloca(function, arith_ty, "x_y");
-            let x_times_y_m = bin.build_alloca(function, arith_ty, "x_times_y_m");
+            bin.builder.build_store(x_m, x);
+            bin.builder.build_store(y_m, y);
+            bin.builder.build_store(k_m, k);
 
-            bin.builder
-                .build_store(x_m, bin.builder.build_int_z_extend(x, arith_ty, "wide_x"));
-            bin.builder
-                .build_store(y_m, bin.builder.build_int_z_extend(y, arith_ty, "wide_y"));
+            // codegen has already checked that k is not zero
+            let name = if *kind == Builtin::AddMod {
+                "addmod256"
+            } else {
+                "mulmod256"
+            };
 
             bin.builder.build_call(
-                bin.module.get_function("__mul32").unwrap(),
-                &[
-                    x_m.into(),
-                    y_m.into(),
-                    x_times_y_m.into(),
-                    bin.context.i32_type().const_int(512 / 32, false).into(),
-                ],
+                bin.module.get_function(name).unwrap(),
+                &[x_m.into(), y_m.into(), k_m.into(), out.into()],
                 "",
             );
-            let k = expression(target, bin, &args[2], vartab, function, ns).into_int_value();
-            let dividend = bin.builder.build_load(arith_ty, x_times_y_m, "x_t_y");
-
-            let divisor = bin.builder.build_int_z_extend(k, arith_ty, "wide_k");
-
-            let pdividend = bin.build_alloca(function, arith_ty, "dividend");
-            let pdivisor = bin.build_alloca(function, arith_ty, "divisor");
-            let rem = bin.build_alloca(function, arith_ty, "remainder");
-            let quotient = bin.build_alloca(function, arith_ty, "quotient");
 
-            bin.builder.build_store(pdividend, dividend);
-            bin.builder.build_store(pdivisor, divisor);
-
-            let ret = bin
-                .builder
-                .build_call(
-                    bin.module.get_function("udivmod512").unwrap(),
-                    &[
-                        pdividend.into(),
-                        pdivisor.into(),
-                        rem.into(),
-                        quotient.into(),
-                    ],
-                    "quotient",
-                )
-                .try_as_basic_value()
-                .left()
-                .unwrap()
-                .into_int_value();
-
-            let success = bin.builder.build_int_compare(
-                IntPredicate::EQ,
-                ret,
-                bin.context.i32_type().const_zero(),
-                "success",
-            );
-
-            let success_block = bin.context.append_basic_block(function, "success");
-            let bail_block = bin.context.append_basic_block(function, "bail");
-            bin.builder
-                .build_conditional_branch(success, success_block, bail_block);
-
-            bin.builder.position_at_end(bail_block);
-
-            // On Solana the return type is 64 bit
-            let ret: BasicValueEnum = bin
-                .builder
-                .build_int_z_extend(
-                    ret,
-                    bin.return_values[&ReturnCode::Success].get_type(),
-                    "ret",
-                )
-                .into();
-
-            bin.builder.build_return(Some(&ret));
-
-            bin.builder.position_at_end(success_block);
-
-            let remainder = bin
-                .builder
-                .build_load(arith_ty, rem, "quotient")
-                .into_int_value();
-
-            bin.builder
-                .build_int_truncate(remainder, res_ty, "quotient")
-                .into()
+            bin.builder.build_load(arith_ty, out, "result")
         }
         Expression::Builtin {
             kind: hash @ Builtin::Ripemd160,
@@ -1987,3 +1890,20 @@ fn runtime_cast<'a>(
         val
     }
 }
+
+/// Flatten a chain of string concatenations into its pieces, from left to right
+fn string_concat_pieces<'b>(
+    location: &'b StringLocation<Expression>,
+    pieces: &mut Vec<&'b StringLocation<Expression>>,
+) {
+    if let StringLocation::RunTime(expr) = location {
+        if let Expression::StringConcat { left, right, .. } = expr.as_ref() {
+            string_concat_pieces(left, pieces);
+            string_concat_pieces(right, pieces);
+
+            return;
+        }
+    }
+
+    pieces.push(location);
+}
@@ -170,32 +170,29 @@ pub(super) fn process_instruction<'a, T: TargetRuntime<'a> + ?Sized>(
             let llvm_ty = bin.llvm_type(ty, ns);
             let elem_ty = ty.array_elem();
 
-            // Calculate total size for reallocation
             let llvm_elem_ty = bin.llvm_field_ty(&elem_ty, ns);
             let elem_size = llvm_elem_ty
                 .size_of()
                 .unwrap()
                 .const_cast(bin.context.i32_type(), false);
             let len = bin.vector_len(arr);
-            let new_len =
+
+            // The value may refer to the array, so evaluate it before the array changes
+            let value = expression(target, bin, value, &w.vars, function, ns);
+            let value = if elem_ty.is_fixed_reference_type(ns) {
+                let load_ty = bin.llvm_type(&elem_ty, ns);
                 bin.builder
-                    .build_int_add(len, bin.context.i32_type().const_int(1, false), "");
-            let vec_size = bin
-                .module
-                .get_struct_type("struct.vector")
-                .unwrap()
-                .size_of()
-                .unwrap()
-                .const_cast(bin.context.i32_type(), false);
-            let size = bin.builder.build_int_mul(elem_size, new_len, "");
-            let size = bin.builder.build_int_add(size, vec_size, "");
+                    .build_load(load_ty, value.into_pointer_value(), "elem")
+            } else {
+                value
+            };
 
-            // Reallocate and reassign the array pointer
+            // Add a member; the vector grows its capacity geometrically, so it may move
             let new = bin
                 .builder
                 .build_call(
-                    bin.module.get_function("__realloc").unwrap(),
-                    &[arr.into(), size.into()],
+                    bin.module.get_function("vector_push").unwrap(),
+                    &[arr.into(), elem_size.into()],
                     "",
                 )
                 .try_as_basic_value()
@@ -217,44 +214,12 @@ pub(super) fn process_instruction<'a, T: TargetRuntime<'a> + ?Sized>(
                     "data",
                 )
             };
-            let value = expression(target, bin, value, &w.vars, function, ns);
-            let value = if elem_ty.is_fixed_reference_type(ns) {
-                w.vars.get_mut(res).unwrap().value = slot_ptr.into();
-                let load_ty = bin.llvm_type(&elem_ty, ns);
-                bin.builder
-                    .build_load(load_ty, value.into_pointer_value(), "elem")
+            w.vars.get_mut(res).unwrap().value = if elem_ty.is_fixed_reference_type(ns) {
+                slot_ptr.into()
             } else {
-                w.vars.get_mut(res).unwrap().value = value;
                 value
             };
             bin.builder.build_store(slot_ptr, value);
-
-            // Update the len and size field of the vector struct
-            let len_ptr = unsafe {
-                bin.builder.build_gep(
-                    llvm_ty,
-                    new,
-                    &[
-                        bin.context.i32_type().const_zero(),
-                        bin.context.i32_type().const_zero(),
-                    ],
-                    "len",
-                )
-            };
-            bin.builder.build_store(len_ptr, new_len);
-
-            let size_ptr = unsafe {
-                bin.builder.build_gep(
-                    llvm_ty,
-                    new,
-                    &[
-                        bin.context.i32_type().const_zero(),
-                        bin.context.i32_type().const_int(1, false),
-                    ],
-                    "size",
-                )
-            };
-            bin.builder.build_store(size_ptr, new_len);
         }
         Instr::PopMemory {
             res,
@@ -302,7 +267,6 @@ pub(super) fn process_instruction<'a, T: TargetRuntime<'a> + ?Sized>(
             let elem_ty = ty.array_elem();
             let llvm_elem_ty = bin.llvm_field_ty(&elem_ty, ns);
 
-            // Calculate total size for reallocation
             let elem_size = llvm_elem_ty
                 .size_of()
                 .unwrap()
@@ -310,15 +274,6 @@ pub(super) fn process_instruction<'a, T: TargetRuntime<'a> + ?Sized>(
             let new_len =
                 bin.builder
                     .build_int_sub(len, bin.context.i32_type().const_int(1, false), "");
-            let vec_size = bin
-                .module
-                .get_struct_type("struct.vector")
-                .unwrap()
-                .size_of()
-                .unwrap()
-                .const_cast(bin.context.i32_type(), false);
-            let size = bin.builder.build_int_mul(elem_size, new_len, "");
-            let size = bin.builder.build_int_add(size, vec_size, "");
 
             // Get the pointer to the last element and return it
             let slot_ptr = unsafe {
@@ -342,25 +297,12 @@ pub(super) fn process_instruction<'a, T: TargetRuntime<'a> + ?Sized>(
                 w.vars.get_mut(res).unwrap().value = ret_val;
             }
 
-            // Reallocate and reassign the array pointer
-            let new = bin
-                .builder
-                .build_call(
-                    bin.module.get_function("__realloc").unwrap(),
-                    &[a.into(), size.into()],
-                    "",
-                )
-                .try_as_basic_value()
-                .left()
-                .unwrap()
-                .into_pointer_value();
-            w.vars.get_mut(array).unwrap().value = new.into();
-
-            // Update the len and size field of the vector struct
+            // The vector keeps its capacity, so the popped element stays valid and the next
+            // push does not need to reallocate
             let len_ptr = unsafe {
                 bin.builder.build_gep(
                     llvm_ty,
-                    new,
+                    a,
                     &[
                         bin.context.i32_type().const_zero(),
                         bin.context.i32_type().const_zero(),
@@ -369,19 +311,6 @@ pub(super) fn process_instruction<'a, T: TargetRuntime<'a> + ?Sized>(
                 )
             };
             bin.builder.build_store(len_ptr, new_len);
-
-            let size_ptr = unsafe {
-                bin.builder.build_gep(
-                    llvm_ty,
-                    new,
-                    &[
-                        bin.context.i32_type().const_zero(),
-                        bin.context.i32_type().const_int(1, false),
-                    ],
-                    "size",
-                )
-            };
-            bin.builder.build_store(size_ptr, new_len);
         }
         Instr::AssertFailure { encoded_args: None } => {
             target.assert_failure(
@@ -5,7 +5,7 @@ use crate::emit::binary::Binary;
 use crate::emit::{BinaryOp, TargetRuntime};
 use crate::sema::ast::Namespace;
 use inkwell::types::IntType;
-use inkwell::values::{FunctionValue, IntValue, PointerValue};
+use inkwell::values::{CallSiteValue, FunctionValue, IntValue, PointerValue};
 use inkwell::IntPredicate;
 use solang_parser::pt::Loc;
 
@@ -73,19 +73,7 @@ fn signed_ovf_detect<'a, T: TargetRuntime<'a> + ?Sized>(
     bin.builder
         .build_store(r, bin.builder.build_int_z_extend(right_abs, mul_ty, ""));
 
-    let return_val = bin.builder.build_call(
-        bin.module.get_function("__mul32_with_builtin_ovf").unwrap(),
-        &[
-            l.into(),
-            r.into(),
-            o.into(),
-            bin.context
-                .i32_type()
-                .const_int(mul_bits as u64 / 32, false)
-                .into(),
-        ],
-        "",
-    );
+    let return_val = call_mul_kernel(bin, l, r, o, mul_bits, true);
 
     let res = bin.builder.build_load(mul_ty, o, "mul");
     let ovf_any_type = if mul_bits != bits {
@@ -191,7 +179,56 @@ fn signed_ovf_detect<'a, T: TargetRuntime<'a> + ?Sized>(
         .build_int_truncate(res.into_int_value(), left.get_type(), "")
 }
 
-/// Call void __mul32 and return the result.
+/// Call the multiply function in stdlib/bigint.c for the given width. The common widths have
+/// an unrolled kernel; any other multiple of 32 bits uses the generic __mul32 loop. With
+/// overflow detection, the call returns a bool which is set on overflow.
+fn call_mul_kernel<'a>(
+    bin: &Binary<'a>,
+    l: PointerValue<'a>,
+    r: PointerValue<'a>,
+    o: PointerValue<'a>,
+    mul_bits: u32,
+    overflow: bool,
+) -> CallSiteValue<'a> {
+    match mul_bits {
+        64 | 128 | 256 | 512 => {
+            let name = if overflow {
+                format!("__mul{mul_bits}_with_ovf")
+            } else {
+                format!("__mul{mul_bits}")
+            };
+
+            bin.builder.build_call(
+                bin.module.get_function(&name).unwrap(),
+                &[l.into(), r.into(), o.into()],
+                "",
+            )
+        }
+        _ => {
+            let name = if overflow {
+                "__mul32_with_builtin_ovf"
+            } else {
+                "__mul32"
+            };
+
+            bin.builder.build_call(
+                bin.module.get_function(name).unwrap(),
+                &[
+                    l.into(),
+                    r.into(),
+                    o.into(),
+                    bin.context
+                        .i32_type()
+                        .const_int(mul_bits as u64 / 32, false)
+                        .into(),
+                ],
+                "",
+            )
+        }
+    }
+}
+
+/// Call the multiply function and return the result.
 fn call_mul32_without_ovf<'a>(
     bin: &Binary<'a>,
     l: PointerValue<'a>,
@@ -201,19 +238,7 @@ fn call_mul32_without_ovf<'a>(
     mul_type: IntType<'a>,
     res_type: IntType<'a>,
 ) -> IntValue<'a> {
-    bin.builder.build_call(
-        bin.module.get_function("__mul32").unwrap(),
-        &[
-            l.into(),
-            r.into(),
-            o.into(),
-            bin.context
-                .i32_type()
-                .const_int(mul_bits as u64 / 32, false)
-                .into(),
-        ],
-        "",
-    );
+    call_mul_kernel(bin, l, r, o, mul_bits, false);
 
     let res = bin.builder.build_load(mul_type, o, "mul");
 
@@ -286,23 +311,11 @@ pub(super) fn multiply<'a, T: TargetRuntime<'a> + ?Sized>(
             }
 
             // Unsigned overflow detection Approach:
-            // If the size is a multiple of 32, we call __mul32_with_builtin_ovf and it returns an overflow flag (check __mul32_with_builtin_ovf in stdlib/bigint.c documentation)
+            // If the size is a multiple of 32, the multiply kernel returns an overflow flag (check call_mul_kernel and stdlib/bigint.c)
             // If that is not the case, some extra work has to be done. We have to check the extended bits for any set bits. If there is any, an overflow occured.
             // For example, if we have uint72, it will be extended to uint96. __mul32 with ovf will raise an ovf flag if the result overflows 96 bits, not 72.
             // We account for that by checking the extended leftmost bits. In the example mentioned, they will be 96-72=24 bits.
-            let return_val = bin.builder.build_call(
-                bin.module.get_function("__mul32_with_builtin_ovf").unwrap(),
-                &[
-                    l.into(),
-                    r.into(),
-                    o.into(),
-                    bin.context
-                        .i32_type()
-                        .const_int(mul_bits as u64 / 32, false)
-                        .into(),
-                ],
-                "ovf",
-            );
+            let return_val = call_mul_kernel(bin, l, r, o, mul_bits, true);
 
             let res = bin.builder.build_load(mul_ty, o, "mul");
 
@@ -331,7 +344,7 @@ pub(super) fn multiply<'a, T: TargetRuntime<'a> + ?Sized>(
 
             // Until this point, we only checked the extended bits for ovf. But mul ovf can take place any where from bit size to double bit size.
             // For example: If we have uint72, it will be extended to uint96. We only checked the most significant 24 bits for overflow, which can happen up to 72*2=144 bits.
-            // bool __mul32_with_builtin_ovf takes care of overflowing bits beyond 96.
+            // The multiply kernel takes care of overflowing bits beyond 96.
             // What is left now is to or these two ovf flags, and check if any one of them is set. If so, an overflow occured.
             let lowbit = bin.builder.build_int_truncate(
                 bin.builder.build_or(
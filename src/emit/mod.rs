@@ -351,10 +351,12 @@ impl Target {
         })
     }
 
-    /// LLVM Target triple
-    fn llvm_features(&self) -> &'static str {
+    /// LLVM Target features
+    fn llvm_features(&self, opt: &Options) -> &'static str {
         if *self == Target::Solana {
             "+solana"
+        } else if opt.wasm_bulk_memory {
+            "+bulk-memory"
         } else {
             ""
         }
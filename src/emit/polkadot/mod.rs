@@ -239,13 +239,16 @@ impl PolkadotTarget {
         let u32_ptr = ctx.i32_type().ptr_type(AddressSpace::default()).into();
         let u64_val = ctx.i64_type().into();
 
+        // The profiling stdlib already declares "debug_message"
         macro_rules! external {
             ($name:literal, $fn_type:ident, $( $args:expr ),*) => {
-                binary.module.add_function(
-                    $name,
-                    ctx.$fn_type().fn_type(&[$($args),*], false),
-                    Some(Linkage::External),
-                );
+                if binary.module.get_function($name).is_none() {
+                    binary.module.add_function(
+                        $name,
+                        ctx.$fn_type().fn_type(&[$($args),*], false),
+                        Some(Linkage::External),
+                    );
+                }
             };
         }
 
@@ -352,6 +355,18 @@ impl PolkadotTarget {
     }
 }
 
+/// With the profiling stdlib, write its counters to the debug buffer. This has to be done before
+/// "seal_return", which does not return.
+fn profile_log(binary: &Binary) {
+    if !binary.options.stdlib_profile {
+        return;
+    }
+
+    emit_context!(binary);
+
+    call!("__profile_log", &[]);
+}
+
 /// Print the return code of API calls to the debug buffer.
 fn log_return_code(binary: &Binary, api: &'static str, code: IntValue) {
     if !binary.options.log_api_return_codes {
@@ -4,7 +4,7 @@ use crate::codegen::cfg::{HashTy, ReturnCode};
 use crate::codegen::revert::PanicCode;
 use crate::emit::binary::Binary;
 use crate::emit::expression::expression;
-use crate::emit::polkadot::{log_return_code, PolkadotTarget, SCRATCH_SIZE};
+use crate::emit::polkadot::{log_return_code, profile_log, PolkadotTarget, SCRATCH_SIZE};
 use crate::emit::storage::StorageSlot;
 use crate::emit::{ContractArgs, TargetRuntime, Variable};
 use crate::sema::ast;
@@ -721,6 +721,8 @@ impl<'a> TargetRuntime<'a> for PolkadotTarget {
     fn return_empty_abi(&self, binary: &Binary) {
         emit_context!(binary);
 
+        profile_log(binary);
+
         call!(
             "seal_return",
             &[
@@ -757,6 +759,8 @@ impl<'a> TargetRuntime<'a> for PolkadotTarget {
     fn return_abi<'b>(&self, binary: &'b Binary, data: PointerValue<'b>, length: IntValue) {
         emit_context!(binary);
 
+        profile_log(binary);
+
         call!(
             "seal_return",
             &[i32_zero!().into(), data.into(), length.into()]
@@ -773,6 +777,8 @@ impl<'a> TargetRuntime<'a> for PolkadotTarget {
     ) {
         emit_context!(binary);
 
+        profile_log(binary);
+
         call!(
             "seal_return",
             &[i32_zero!().into(), data.into(), data_len.into()]
@@ -786,6 +792,8 @@ impl<'a> TargetRuntime<'a> for PolkadotTarget {
     fn assert_failure(&self, binary: &Binary, data: PointerValue, length: IntValue) {
         emit_context!(binary);
 
+        profile_log(binary);
+
         let flags = i32_const!(1).into(); // First bit set means revert
         call!("seal_return", &[flags, data.into(), length.into()]);
 
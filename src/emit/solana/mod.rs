@@ -70,6 +70,13 @@ impl SolanaTarget {
         // externals
         target.declare_externals(&mut binary, ns);
 
+        // the size of the heap is read by __init_heap
+        if let Some(heap_size) = binary.module.get_global("__heap_size") {
+            heap_size.set_initializer(&context.i32_type().const_int(opt.heap_size.into(), false));
+            heap_size.set_constant(true);
+            heap_size.set_linkage(Linkage::Internal);
+        }
+
         emit_functions(&mut target, &mut binary, contract, ns);
 
         binary.internalize(&[
@@ -85,6 +92,9 @@ impl SolanaTarget {
             "sol_sha256",
             "sol_keccak256",
             "sol_log_data",
+            "sol_memcpy_",
+            "sol_memset_",
+            "sol_memcmp_",
         ]);
 
         binary
@@ -221,23 +231,39 @@ impl SolanaTarget {
 
     /// Returns the SolAccountInfo of the executing binary
     fn contract_storage_account<'b>(&self, binary: &Binary<'b>) -> PointerValue<'b> {
+        // The executing binary is the first account
+        self.sol_accounts(binary)
+    }
+
+    /// Get the pointer to the array of SolAccountInfo
+    fn sol_accounts<'b>(&self, binary: &Binary<'b>) -> PointerValue<'b> {
         let parameters = self.sol_parameters(binary);
 
-        unsafe {
-            binary.builder.build_gep(
+        let ka = binary
+            .builder
+            .build_struct_gep(
                 binary
                     .module
                     .get_struct_type("struct.SolParameters")
                     .unwrap(),
                 parameters,
-                &[
-                    binary.context.i32_type().const_int(0, false),
-                    binary.context.i32_type().const_int(0, false),
-                    binary.context.i32_type().const_int(0, false),
-                ],
-                "account",
+                0,
+                "ka",
             )
-        }
+            .unwrap();
+
+        binary
+            .builder
+            .build_load(
+                binary
+                    .module
+                    .get_struct_type("struct.SolAccountInfo")
+                    .unwrap()
+                    .ptr_type(AddressSpace::default()),
+                ka,
+                "ka",
+            )
+            .into_pointer_value()
     }
 
     /// Get the pointer to SolParameters
@@ -255,28 +281,24 @@ impl SolanaTarget {
 
     /// Returns the account data of the executing binary
     fn contract_storage_data<'b>(&self, binary: &Binary<'b>) -> PointerValue<'b> {
-        let parameters = self.sol_parameters(binary);
+        let account = self.contract_storage_account(binary);
 
         binary
             .builder
             .build_load(
                 binary.context.i8_type().ptr_type(AddressSpace::default()),
-                unsafe {
-                    binary.builder.build_gep(
+                binary
+                    .builder
+                    .build_struct_gep(
                         binary
                             .module
-                            .get_struct_type("struct.SolParameters")
+                            .get_struct_type("struct.SolAccountInfo")
                             .unwrap(),
-                        parameters,
-                        &[
-                            binary.context.i32_type().const_int(0, false),
-                            binary.context.i32_type().const_int(0, false),
-                            binary.context.i32_type().const_int(0, false),
-                            binary.context.i32_type().const_int(3, false),
-                        ],
+                        account,
+                        3,
                         "data",
                     )
-                },
+                    .unwrap(),
                 "data",
             )
             .into_pointer_value()
@@ -1173,18 +1195,7 @@ impl SolanaTarget {
 
         let parameters = self.sol_parameters(binary);
 
-        let account_infos = binary
-            .builder
-            .build_struct_gep(
-                binary
-                    .module
-                    .get_struct_type("struct.SolParameters")
-                    .unwrap(),
-                parameters,
-                0,
-                "ka",
-            )
-            .unwrap();
+        let account_infos = self.sol_accounts(binary);
 
         let account_infos_len = binary.builder.build_int_truncate(
             binary
@@ -1680,24 +1680,19 @@ impl<'a> TargetRuntime<'a> for SolanaTarget {
             } => {
                 assert_eq!(args.len(), 0);
 
-                let parameters = self.sol_parameters(binary);
-
-                let key = unsafe {
-                    binary.builder.build_gep(
+                // first field of the first SolAccountInfo (key)
+                let key = binary
+                    .builder
+                    .build_struct_gep(
                         binary
                             .module
-                            .get_struct_type("struct.SolParameters")
+                            .get_struct_type("struct.SolAccountInfo")
                             .unwrap(),
-                        parameters,
-                        &[
-                            binary.context.i32_type().const_int(0, false), // first SolParameters
-                            binary.context.i32_type().const_int(0, false), // first field of SolParameters
-                            binary.context.i32_type().const_int(0, false), // first element of ka[]
-                            binary.context.i32_type().const_int(0, false), // first field of SolAccountInfo (key)
-                        ],
+                        self.sol_accounts(binary),
+                        0,
                         "key",
                     )
-                };
+                    .unwrap();
 
                 let key_pointer = binary.builder.build_load(
                     binary.address_type(ns).ptr_type(AddressSpace::default()),
@@ -1937,24 +1932,7 @@ impl<'a> TargetRuntime<'a> for SolanaTarget {
             } => {
                 assert_eq!(args.len(), 0);
 
-                let parameters = self.sol_parameters(binary);
-
-                unsafe {
-                    binary.builder.build_gep(
-                        binary
-                            .module
-                            .get_struct_type("struct.SolParameters")
-                            .unwrap(),
-                        parameters,
-                        &[
-                            binary.context.i32_type().const_int(0, false),
-                            binary.context.i32_type().const_int(0, false),
-                            binary.context.i32_type().const_int(0, false),
-                        ],
-                        "accounts",
-                    )
-                }
-                .into()
+                self.sol_accounts(binary).into()
             }
             codegen::Expression::Builtin {
                 kind: codegen::Builtin::ArrayLength,
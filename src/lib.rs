@@ -9,6 +9,9 @@ pub mod file_resolver;
 mod linker;
 pub mod standard_json;
 
+#[cfg(feature = "llvm")]
+pub use linker::{link_worker, peak_concurrent_links, set_link_worker};
+
 // In Sema, we use result unit for returning early
 // when code-misparses. The error will be added to the namespace diagnostics, no need to have anything but unit
 // as error.
@@ -15,26 +15,7 @@ use std::io::Read;
 use std::io::Write;
 use tempfile::tempdir;
 
-pub fn link(input: &[u8], name: &str) -> Vec<u8> {
-    let dir = tempdir().expect("failed to create temp directory for linking");
-
-    let object_filename = dir.path().join(format!("{name}.o"));
-    let res_filename = dir.path().join(format!("{name}.so"));
-    let linker_script_filename = dir.path().join("linker.ld");
-
-    let mut objectfile =
-        File::create(object_filename.clone()).expect("failed to create object file");
-
-    objectfile
-        .write_all(input)
-        .expect("failed to write object file to temp file");
-
-    let mut linker_script =
-        File::create(linker_script_filename.clone()).expect("failed to create linker script");
-
-    linker_script
-        .write_all(
-            br##"
+const LINKER_SCRIPT: &[u8] = br##"
 ENTRY(entrypoint)
 
 PHDRS
@@ -56,30 +37,101 @@ SECTIONS
     .gnu.hash : { *(.gnu.hash) } :dynamic
     .rel.dyn : { *(.rel.dyn) } :dynamic
     .hash : { *(.hash) } :dynamic
-}"##,
-        )
-        .expect("failed to write linker script to temp file");
+}"##;
+
+pub fn link(input: &[u8], name: &str, min_size: bool) -> Vec<u8> {
+    let command_line = command_line(min_size);
 
-    let command_line = vec![
+    if let Some(output) = link_in_memory(&command_line, input, name) {
+        return output;
+    }
+
+    link_using_files(command_line, input, name)
+}
+
+pub(super) fn command_line(min_size: bool) -> Vec<CString> {
+    let mut command_line = vec![
         CString::new("-z").unwrap(),
         CString::new("notext").unwrap(),
         CString::new("-shared").unwrap(),
         CString::new("--Bdynamic").unwrap(),
+    ];
+
+    // Each function and constant is in its own section, see Binary::code(). The loader
+    // only needs the dynamic symbols, so the static symbol table can go too. There is no
+    // --icf: the object has no address significance table, so lld would either fold nothing
+    // (--icf=safe) or also fold functions whose address is compared (--icf=all). Identical
+    // functions are merged before code generation instead.
+    if min_size {
+        command_line.push(CString::new("--gc-sections").unwrap());
+        command_line.push(CString::new("--strip-all").unwrap());
+    }
+
+    command_line
+}
+
+pub(super) fn link_in_memory(
+    command_line: &[CString],
+    input: &[u8],
+    name: &str,
+) -> Option<Vec<u8>> {
+    let object_filename = format!("{name}.o");
+
+    super::elf_linker_in_memory(
+        command_line,
+        &[
+            ("linker.ld", LINKER_SCRIPT),
+            (object_filename.as_str(), input),
+        ],
+    )
+}
+
+/// Fallback for when in-memory linking is not available: write the object file and the
+/// linker script to a temporary directory, and read the linked result back
+pub(super) fn link_using_files(
+    mut command_line: Vec<CString>,
+    input: &[u8],
+    name: &str,
+) -> Vec<u8> {
+    let dir = tempdir().expect("failed to create temp directory for linking");
+
+    let object_filename = dir.path().join(format!("{name}.o"));
+    let res_filename = dir.path().join(format!("{name}.so"));
+    let linker_script_filename = dir.path().join("linker.ld");
+
+    let mut objectfile =
+        File::create(object_filename.clone()).expect("failed to create object file");
+
+    objectfile
+        .write_all(input)
+        .expect("failed to write object file to temp file");
+
+    let mut linker_script =
+        File::create(linker_script_filename.clone()).expect("failed to create linker script");
+
+    linker_script
+        .write_all(LINKER_SCRIPT)
+        .expect("failed to write linker script to temp file");
+
+    command_line.push(
         CString::new(
             linker_script_filename
                 .to_str()
                 .expect("temp path should be unicode"),
         )
         .unwrap(),
+    );
+    command_line.push(
         CString::new(
             object_filename
                 .to_str()
                 .expect("temp path should be unicode"),
         )
         .unwrap(),
-        CString::new("-o").unwrap(),
-        CString::new(res_filename.to_str().expect("temp path should be unicode")).unwrap(),
-    ];
+    );
+    command_line.push(CString::new("-o").unwrap());
+    command_line
+        .push(CString::new(res_filename.to_str().expect("temp path should be unicode")).unwrap());
 
     assert!(!super::elf_linker(&command_line), "linker failed");
 
@@ -93,3 +145,29 @@ SECTIONS
 
     output
 }
+
+/// Read the section headers of a 64 bit little endian ELF file
+pub fn section_sizes(code: &[u8]) -> Vec<(String, usize)> {
+    let u16_at = |offset: usize| u16::from_le_bytes(code[offset..offset + 2].try_into().unwrap());
+    let u32_at = |offset: usize| u32::from_le_bytes(code[offset..offset + 4].try_into().unwrap());
+    let u64_at = |offset: usize| u64::from_le_bytes(code[offset..offset + 8].try_into().unwrap());
+
+    let section_headers = u64_at(0x28) as usize;
+    let header_size = u16_at(0x3a) as usize;
+    let sections = u16_at(0x3c) as usize;
+    let names = u64_at(section_headers + u16_at(0x3e) as usize * header_size + 0x18) as usize;
+
+    // the first section header is always empty
+    (1..sections)
+        .map(|no| {
+            let header = section_headers + no * header_size;
+            let name = &code[names + u32_at(header) as usize..];
+            let name = &name[..name.iter().position(|b| *b == 0).unwrap()];
+
+            (
+                String::from_utf8_lossy(name).to_string(),
+                u64_at(header + 0x20) as usize,
+            )
+        })
+        .collect()
+}
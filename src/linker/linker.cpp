@@ -3,16 +3,227 @@
 // Call the LLD linker
 #include "lld/Common/Driver.h"
 
-extern "C" bool LLDWasmLink(const char *argv[], size_t length)
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+typedef bool (*LinkFn)(llvm::ArrayRef<const char *>, llvm::raw_ostream &, llvm::raw_ostream &, bool, bool);
+
+// Return values of the in-memory link functions
+enum
+{
+	LINK_SUCCESS = 0,
+	LINK_FAILED = 1,
+	LINK_UNAVAILABLE = 2,
+};
+
+// An input file for the in-memory link functions
+struct LinkerInput
+{
+	const char *name;
+	const uint8_t *data;
+	size_t length;
+};
+
+// lld keeps its state in globals, so it cannot link twice in the same process at the
+// same time. The caller makes sure only one link is in progress; links which should run
+// at the same time are done in separate link worker processes, see mod.rs.
+static bool inProcessLink(LinkFn link, const char *argv[], size_t length)
 {
 	llvm::ArrayRef<const char *> args(argv, length);
 
-	return lld::wasm::link(args, llvm::outs(), llvm::errs(), false, false);
+	return link(args, llvm::outs(), llvm::errs(), false, false);
+}
+
+#ifdef __linux__
+static bool writeAll(int fd, const uint8_t *data, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t written = write(fd, data, length);
+
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		data += written;
+		length -= written;
+	}
+
+	return true;
+}
+
+// Read from fd until end of file
+static void readAll(int fd, std::vector<uint8_t> *data)
+{
+	uint8_t buf[65536];
+
+	for (;;)
+	{
+		ssize_t got = read(fd, buf, sizeof(buf));
+
+		if (got < 0 && errno == EINTR)
+			continue;
+
+		if (got <= 0)
+			break;
+
+		data->insert(data->end(), buf, buf + got);
+	}
+}
+#endif
+
+// lld names the inputs by their /proc/self/fd/ paths in its diagnostics, so use the names
+// of the inputs instead
+static std::string nameInputs(std::string text, const std::vector<std::string> &paths, const LinkerInput *inputs)
+{
+	// Longest paths first, so that /proc/self/fd/1 is not replaced in /proc/self/fd/10
+	std::vector<size_t> order(paths.size());
+
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(),
+			  [&paths](size_t a, size_t b) { return paths[a].size() > paths[b].size(); });
+
+	for (size_t i : order)
+	{
+		size_t nameLength = strlen(inputs[i].name);
+
+		for (size_t pos = text.find(paths[i]); pos != std::string::npos; pos = text.find(paths[i], pos + nameLength))
+			text.replace(pos, paths[i].size(), inputs[i].name);
+	}
+
+	return text;
+}
+
+// Link without touching the file system. The inputs are copied to anonymous memory
+// files, and passed to lld as /proc/self/fd/ paths. The output path is the write end
+// of a pipe. Since that is not a regular file, lld builds the output in memory and
+// then writes it to the path, and a thread collects it from the read end. If the
+// /proc/self/fd/ paths cannot be opened, the caller has to link using files.
+static int inMemoryLink(LinkFn link, const char *argv[], size_t length, const LinkerInput *inputs,
+						size_t inputsLength, uint8_t **output, size_t *outputLength)
+{
+#ifdef __linux__
+	int pipeFds[2];
+
+	if (pipe2(pipeFds, O_CLOEXEC) < 0)
+		return LINK_UNAVAILABLE;
+
+	std::vector<int> fds;
+	std::vector<std::string> paths;
+	bool ready = true;
+
+	for (size_t i = 0; ready && i < inputsLength; i++)
+	{
+		int fd = memfd_create(inputs[i].name, MFD_CLOEXEC);
+
+		if (fd < 0)
+		{
+			ready = false;
+			break;
+		}
+
+		fds.push_back(fd);
+		paths.push_back("/proc/self/fd/" + std::to_string(fd));
+
+		// /proc may not be mounted, for example in a container or a chroot
+		if (i == 0 && access(paths[0].c_str(), R_OK) < 0)
+		{
+			ready = false;
+			break;
+		}
+
+		ready = writeAll(fd, inputs[i].data, inputs[i].length);
+	}
+
+	int result = LINK_UNAVAILABLE;
+
+	if (ready)
+	{
+		std::vector<uint8_t> data;
+		std::thread reader(readAll, pipeFds[0], &data);
+		std::string outputPath = "/proc/self/fd/" + std::to_string(pipeFds[1]);
+		std::vector<const char *> args(argv, argv + length);
+
+		for (const std::string &path : paths)
+			args.push_back(path.c_str());
+
+		args.push_back("-o");
+		args.push_back(outputPath.c_str());
+
+		std::string diagnostics;
+		llvm::raw_string_ostream errs(diagnostics);
+
+		bool success = link(args, llvm::outs(), errs, false, false);
+
+		errs.flush();
+		llvm::errs() << nameInputs(diagnostics, paths, inputs);
+
+		// lld has closed its own descriptor for the path, so this ends the output
+		close(pipeFds[1]);
+		pipeFds[1] = -1;
+		reader.join();
+
+		if (!success)
+		{
+			result = LINK_FAILED;
+		}
+		else if (uint8_t *buf = static_cast<uint8_t *>(malloc(data.size() ? data.size() : 1)))
+		{
+			std::copy(data.begin(), data.end(), buf);
+			*output = buf;
+			*outputLength = data.size();
+			result = LINK_SUCCESS;
+		}
+	}
+
+	for (int fd : fds)
+		close(fd);
+
+	close(pipeFds[0]);
+
+	if (pipeFds[1] >= 0)
+		close(pipeFds[1]);
+
+	return result;
+#else
+	return LINK_UNAVAILABLE;
+#endif
+}
+
+extern "C" bool LLDWasmLink(const char *argv[], size_t length)
+{
+	return inProcessLink(lld::wasm::link, argv, length);
 }
 
 extern "C" bool LLDELFLink(const char *argv[], size_t length)
 {
-	llvm::ArrayRef<const char *> args(argv, length);
+	return inProcessLink(lld::elf::link, argv, length);
+}
 
-	return lld::elf::link(args, llvm::outs(), llvm::errs(), false, false);
+// On success, the linked output is returned in a buffer which must be released with free()
+extern "C" int LLDWasmLinkInMemory(const char *argv[], size_t length, const LinkerInput *inputs, size_t inputsLength,
+								   uint8_t **output, size_t *outputLength)
+{
+	return inMemoryLink(lld::wasm::link, argv, length, inputs, inputsLength, output, outputLength);
+}
+
+extern "C" int LLDELFLinkInMemory(const char *argv[], size_t length, const LinkerInput *inputs, size_t inputsLength,
+								  uint8_t **output, size_t *outputLength)
+{
+	return inMemoryLink(lld::elf::link, argv, length, inputs, inputsLength, output, outputLength);
 }
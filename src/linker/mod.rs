@@ -1,36 +1,272 @@
 // SPDX-License-Identifier: Apache-2.0
 
 mod bpf;
+#[cfg(test)]
+mod tests;
 mod wasm;
 
 use crate::Target;
-use once_cell::sync::Lazy;
-use std::ffi::CString;
-use std::sync::Mutex;
-
-static LINKER_MUTEX: Lazy<Mutex<i32>> = Lazy::new(|| Mutex::new(0i32));
+use std::ffi::{CString, OsStr, OsString};
+use std::io::{Read, Write};
+use std::path::{Path, PathBuf};
+use std::process::{Command, Stdio};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Mutex, PoisonError};
 
 /// Take an object file and turn it into a final linked binary ready for deployment
-pub fn link(input: &[u8], name: &str, target: Target) -> Vec<u8> {
-    // The lld linker is totally not thread-safe; it uses many globals
-    // We should fix this one day
-    let _lock = LINKER_MUTEX.lock().unwrap();
+///
+/// This may be called from many threads at once. The lld linker is not thread-safe since
+/// it uses many globals, so each link runs in a link worker process if one has been set
+/// with `set_link_worker()`. Otherwise the links are done in this process, one at a time.
+///
+/// With `min_size`, the linker removes unused sections and strips the symbols which are not
+/// needed to load the binary. Identical functions have already been merged by codegen.
+pub fn link(input: &[u8], name: &str, target: Target, min_size: bool) -> Vec<u8> {
+    if target == Target::Solana {
+        bpf::link(input, name, min_size)
+    } else {
+        wasm::link(input, name, min_size)
+    }
+}
 
+/// Return the name and size in bytes of each section in a linked binary
+pub fn section_sizes(code: &[u8], target: Target) -> Vec<(String, usize)> {
     if target == Target::Solana {
-        bpf::link(input, name)
+        bpf::section_sizes(code)
     } else {
-        wasm::link(input, name)
+        wasm::section_sizes(code)
+    }
+}
+
+/// The argument which starts a link worker, see `link_worker()`
+const LINK_WORKER_ARG: &str = "--link-worker";
+
+/// The program which is run to link in a separate process
+static LINK_WORKER: Mutex<Option<PathBuf>> = Mutex::new(None);
+
+/// lld cannot link twice in the same process at the same time
+static IN_PROCESS_LINK: Mutex<()> = Mutex::new(());
+
+/// The number of links in progress, and the most there have been in progress at once
+static LINKS: AtomicUsize = AtomicUsize::new(0);
+static PEAK_LINKS: AtomicUsize = AtomicUsize::new(0);
+
+/// Return codes of the in-memory link functions in linker.cpp, also used as the exit status
+/// of a link worker
+const LINK_SUCCESS: libc::c_int = 0;
+const LINK_FAILED: libc::c_int = 1;
+const LINK_UNAVAILABLE: libc::c_int = 2;
+
+/// Counts a link as in progress for as long as it lives
+struct LinkInProgress;
+
+impl LinkInProgress {
+    fn start() -> Self {
+        let links = LINKS.fetch_add(1, Ordering::SeqCst) + 1;
+
+        PEAK_LINKS.fetch_max(links, Ordering::SeqCst);
+
+        LinkInProgress
+    }
+}
+
+impl Drop for LinkInProgress {
+    fn drop(&mut self) {
+        LINKS.fetch_sub(1, Ordering::SeqCst);
+    }
+}
+
+/// Do the links in child processes, so that they can run at the same time. The `program` is
+/// run with `--link-worker` as its first argument, and must pass its arguments to
+/// `link_worker()`. The solang executable does this. If the program cannot be run, the link
+/// is done in this process.
+pub fn set_link_worker(program: PathBuf) {
+    *LINK_WORKER.lock().unwrap_or_else(PoisonError::into_inner) = Some(program);
+}
+
+/// The most links which have been in progress at the same time
+pub fn peak_concurrent_links() -> usize {
+    PEAK_LINKS.load(Ordering::SeqCst)
+}
+
+/// If the command line `args` (including the program name) start a link worker, do the link
+/// and return the exit status for the process.
+///
+/// The arguments after `--link-worker` are the linker executable name and its command line.
+/// The input files for an in-memory link are read from stdin, and the linked output is
+/// written to stdout. Without any inputs, the command line names the files.
+pub fn link_worker(args: &[OsString]) -> Option<i32> {
+    if args.get(1).map(OsString::as_os_str) != Some(OsStr::new(LINK_WORKER_ARG)) {
+        return None;
+    }
+
+    let (executable, file_linker, in_memory_linker): (&str, FileLinker, InMemoryLinker) =
+        match args.get(2).and_then(|arg| arg.to_str()) {
+            Some(executable @ "ld.lld") => (executable, LLDELFLink, LLDELFLinkInMemory),
+            Some(executable @ "wasm-ld") => (executable, LLDWasmLink, LLDWasmLinkInMemory),
+            _ => {
+                eprintln!("error: {LINK_WORKER_ARG} expects ld.lld or wasm-ld");
+                return Some(LINK_FAILED);
+            }
+        };
+
+    let command_line: Vec<CString> = args[3..]
+        .iter()
+        .map(|arg| CString::new(arg.to_str().expect("linker arguments should be unicode")).unwrap())
+        .collect();
+
+    let mut request = Vec::new();
+
+    std::io::stdin()
+        .read_to_end(&mut request)
+        .expect("failed to read link worker inputs");
+
+    let inputs = decode_inputs(&request);
+
+    if inputs.is_empty() {
+        let failed = link_in_process(file_linker, executable, &command_line);
+
+        return Some(if failed { LINK_FAILED } else { LINK_SUCCESS });
+    }
+
+    let inputs: Vec<(&str, &[u8])> = inputs
+        .iter()
+        .map(|(name, data)| (name.as_str(), data.as_slice()))
+        .collect();
+
+    match link_in_process_in_memory(in_memory_linker, executable, &command_line, &inputs) {
+        Ok(code) => {
+            std::io::stdout()
+                .write_all(&code)
+                .expect("failed to write linked output");
+
+            Some(LINK_SUCCESS)
+        }
+        Err(res) => Some(res),
+    }
+}
+
+/// The inputs are sent to a link worker as the number of inputs, followed by the length and
+/// bytes of the name and then of the data of each input. The lengths are 64 bit little endian.
+fn encode_inputs(inputs: &[(&str, &[u8])]) -> Vec<u8> {
+    let mut request = Vec::new();
+
+    request.extend((inputs.len() as u64).to_le_bytes());
+
+    for (name, data) in inputs {
+        request.extend((name.len() as u64).to_le_bytes());
+        request.extend(name.as_bytes());
+        request.extend((data.len() as u64).to_le_bytes());
+        request.extend(*data);
+    }
+
+    request
+}
+
+fn decode_inputs(mut request: &[u8]) -> Vec<(String, Vec<u8>)> {
+    fn take<'a>(request: &mut &'a [u8], len: usize) -> &'a [u8] {
+        assert!(request.len() >= len, "link worker inputs are truncated");
+
+        let (bytes, rest) = request.split_at(len);
+
+        *request = rest;
+
+        bytes
+    }
+
+    fn take_len(request: &mut &[u8]) -> usize {
+        u64::from_le_bytes(take(request, 8).try_into().unwrap()) as usize
     }
+
+    if request.is_empty() {
+        return Vec::new();
+    }
+
+    (0..take_len(&mut request))
+        .map(|_| {
+            let len = take_len(&mut request);
+            let name = String::from_utf8(take(&mut request, len).to_vec()).unwrap();
+            let len = take_len(&mut request);
+            let data = take(&mut request, len).to_vec();
+
+            (name, data)
+        })
+        .collect()
+}
+
+/// Run the link worker, and return the linked output or the exit status it failed with. If
+/// the worker cannot be started, `None` is returned.
+fn run_link_worker(
+    program: &Path,
+    executable: &str,
+    args: &[CString],
+    inputs: &[(&str, &[u8])],
+) -> Option<Result<Vec<u8>, libc::c_int>> {
+    let mut child = Command::new(program)
+        .arg(LINK_WORKER_ARG)
+        .arg(executable)
+        .args(
+            args.iter()
+                .map(|arg| arg.to_str().expect("linker arguments should be unicode")),
+        )
+        .stdin(Stdio::piped())
+        .stdout(Stdio::piped())
+        .spawn()
+        .ok()?;
+
+    let _link = LinkInProgress::start();
+
+    // The worker reads all of its inputs before it writes anything, so this cannot block on
+    // a full stdout pipe. If the worker has exited early, its exit status says why.
+    let mut stdin = child.stdin.take().unwrap();
+
+    let _ = stdin.write_all(&encode_inputs(inputs));
+
+    drop(stdin);
+
+    let output = child
+        .wait_with_output()
+        .expect("failed to wait for link worker");
+
+    Some(match output.status.code() {
+        Some(LINK_SUCCESS) => Ok(output.stdout),
+        Some(res) => Err(res),
+        None => Err(LINK_FAILED),
+    })
+}
+
+fn link_worker_program() -> Option<PathBuf> {
+    LINK_WORKER
+        .lock()
+        .unwrap_or_else(PoisonError::into_inner)
+        .clone()
 }
 
+type FileLinker =
+    unsafe extern "C" fn(args: *const *const libc::c_char, size: libc::size_t) -> libc::c_int;
+
 extern "C" {
     fn LLDELFLink(args: *const *const libc::c_char, size: libc::size_t) -> libc::c_int;
+
+    fn LLDWasmLink(args: *const *const libc::c_char, size: libc::size_t) -> libc::c_int;
 }
 
-pub fn elf_linker(args: &[CString]) -> bool {
+/// Link the files named on the command line, and return true if the link failed
+fn link_files(linker: FileLinker, executable: &str, args: &[CString]) -> bool {
+    if let Some(program) = link_worker_program() {
+        if let Some(res) = run_link_worker(&program, executable, args, &[]) {
+            return res.is_err();
+        }
+    }
+
+    link_in_process(linker, executable, args)
+}
+
+/// Link in this process, one link at a time, and return true if the link failed
+fn link_in_process(linker: FileLinker, executable: &str, args: &[CString]) -> bool {
     let mut command_line: Vec<*const libc::c_char> = Vec::with_capacity(args.len() + 1);
 
-    let executable_name = CString::new("ld.lld").unwrap();
+    let executable_name = CString::new(executable).unwrap();
 
     command_line.push(executable_name.as_ptr());
 
@@ -38,17 +274,88 @@ pub fn elf_linker(args: &[CString]) -> bool {
         command_line.push(arg.as_ptr());
     }
 
-    unsafe { LLDELFLink(command_line.as_ptr(), command_line.len()) == 0 }
+    let _guard = IN_PROCESS_LINK
+        .lock()
+        .unwrap_or_else(PoisonError::into_inner);
+    let _link = LinkInProgress::start();
+
+    unsafe { linker(command_line.as_ptr(), command_line.len()) == 0 }
 }
 
-extern "C" {
-    fn LLDWasmLink(args: *const *const libc::c_char, size: libc::size_t) -> libc::c_int;
+pub fn elf_linker(args: &[CString]) -> bool {
+    link_files(LLDELFLink, "ld.lld", args)
 }
 
 pub fn wasm_linker(args: &[CString]) -> bool {
+    link_files(LLDWasmLink, "wasm-ld", args)
+}
+
+/// An input file for the in-memory linker functions in linker.cpp
+#[repr(C)]
+struct LinkerInput {
+    name: *const libc::c_char,
+    data: *const u8,
+    length: libc::size_t,
+}
+
+type InMemoryLinker = unsafe extern "C" fn(
+    args: *const *const libc::c_char,
+    size: libc::size_t,
+    inputs: *const LinkerInput,
+    inputs_len: libc::size_t,
+    output: *mut *mut u8,
+    output_len: *mut libc::size_t,
+) -> libc::c_int;
+
+extern "C" {
+    fn LLDELFLinkInMemory(
+        args: *const *const libc::c_char,
+        size: libc::size_t,
+        inputs: *const LinkerInput,
+        inputs_len: libc::size_t,
+        output: *mut *mut u8,
+        output_len: *mut libc::size_t,
+    ) -> libc::c_int;
+
+    fn LLDWasmLinkInMemory(
+        args: *const *const libc::c_char,
+        size: libc::size_t,
+        inputs: *const LinkerInput,
+        inputs_len: libc::size_t,
+        output: *mut *mut u8,
+        output_len: *mut libc::size_t,
+    ) -> libc::c_int;
+}
+
+/// Link the given files without writing them to disk. The inputs are added to the end of
+/// the command line, and the linked output is returned. If in-memory linking is not
+/// available on this platform, `None` is returned and the caller should link using files.
+fn link_in_memory(
+    linker: InMemoryLinker,
+    executable: &str,
+    args: &[CString],
+    inputs: &[(&str, &[u8])],
+) -> Option<Vec<u8>> {
+    let res = link_worker_program()
+        .and_then(|program| run_link_worker(&program, executable, args, inputs))
+        .unwrap_or_else(|| link_in_process_in_memory(linker, executable, args, inputs));
+
+    match res {
+        Ok(code) => Some(code),
+        Err(LINK_UNAVAILABLE) => None,
+        Err(_) => panic!("linker failed"),
+    }
+}
+
+fn link_in_process_in_memory(
+    linker: InMemoryLinker,
+    executable: &str,
+    args: &[CString],
+    inputs: &[(&str, &[u8])],
+) -> Result<Vec<u8>, libc::c_int> {
     let mut command_line: Vec<*const libc::c_char> = Vec::with_capacity(args.len() + 1);
 
-    let executable_name = CString::new("wasm-ld").unwrap();
+    let executable_name = CString::new(executable).unwrap();
 
     command_line.push(executable_name.as_ptr());
 
@@ -56,5 +363,57 @@ pub fn wasm_linker(args: &[CString]) -> bool {
         command_line.push(arg.as_ptr());
     }
 
-    unsafe { LLDWasmLink(command_line.as_ptr(), command_line.len()) == 0 }
+    let names: Vec<CString> = inputs
+        .iter()
+        .map(|(name, _)| CString::new(*name).unwrap())
+        .collect();
+
+    let files: Vec<LinkerInput> = inputs
+        .iter()
+        .zip(&names)
+        .map(|((_, data), name)| LinkerInput {
+            name: name.as_ptr(),
+            data: data.as_ptr(),
+            length: data.len(),
+        })
+        .collect();
+
+    let mut output: *mut u8 = std::ptr::null_mut();
+    let mut output_len: libc::size_t = 0;
+
+    let res = {
+        let _guard = IN_PROCESS_LINK
+            .lock()
+            .unwrap_or_else(PoisonError::into_inner);
+        let _link = LinkInProgress::start();
+
+        unsafe {
+            linker(
+                command_line.as_ptr(),
+                command_line.len(),
+                files.as_ptr(),
+                files.len(),
+                &mut output,
+                &mut output_len,
+            )
+        }
+    };
+
+    if res != LINK_SUCCESS {
+        return Err(res);
+    }
+
+    let code = unsafe { std::slice::from_raw_parts(output, output_len) }.to_vec();
+
+    unsafe { libc::free(output as *mut libc::c_void) };
+
+    Ok(code)
+}
+
+pub fn elf_linker_in_memory(args: &[CString], inputs: &[(&str, &[u8])]) -> Option<Vec<u8>> {
+    link_in_memory(LLDELFLinkInMemory, "ld.lld", args, inputs)
+}
+
+pub fn wasm_linker_in_memory(args: &[CString], inputs: &[(&str, &[u8])]) -> Option<Vec<u8>> {
+    link_in_memory(LLDWasmLinkInMemory, "wasm-ld", args, inputs)
 }
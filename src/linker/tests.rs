@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: Apache-2.0
+
+use super::{bpf, link, peak_concurrent_links, set_link_worker, wasm};
+use crate::codegen::{self, Options};
+use crate::emit::Generate;
+use crate::file_resolver::FileResolver;
+use crate::{parse_and_resolve, Target};
+use std::ffi::OsStr;
+use std::thread;
+
+/// Compile the contracts in `src` and return the object file and name of each
+fn objects(src: &str, target: Target) -> Vec<(Vec<u8>, String)> {
+    let mut resolver = FileResolver::default();
+
+    resolver.set_file_contents("test.sol", src.to_string());
+
+    let mut ns = parse_and_resolve(OsStr::new("test.sol"), &mut resolver, target);
+    let opts = Options::default();
+
+    codegen::codegen(&mut ns, &opts);
+
+    assert!(!ns.diagnostics.any_errors());
+
+    let context = inkwell::context::Context::create();
+
+    ns.contracts
+        .iter()
+        .filter(|contract| contract.instantiable)
+        .map(|contract| {
+            let binary = contract.binary(&ns, &context, &opts);
+
+            (
+                binary.code(Generate::Object).unwrap(),
+                contract.name.clone(),
+            )
+        })
+        .collect()
+}
+
+fn contracts(count: usize) -> String {
+    (0..count)
+        .map(|no| {
+            format!(
+                "contract c{no} {{
+                    function f(uint64 a) public pure returns (uint64) {{
+                        return a * {no};
+                    }}
+                }}\n"
+            )
+        })
+        .collect()
+}
+
+#[test]
+fn concurrent_links() {
+    let targets = [Target::Solana, Target::default_polkadot()];
+
+    // link one at a time in this process first
+    let objects: Vec<_> = targets
+        .iter()
+        .map(|target| objects(&contracts(16), *target))
+        .collect();
+
+    let expected: Vec<Vec<Vec<u8>>> = targets
+        .iter()
+        .zip(&objects)
+        .map(|(target, objects)| {
+            objects
+                .iter()
+                .map(|(object, name)| link(object, name, *target, false))
+                .collect()
+        })
+        .collect();
+
+    let worker = assert_cmd::cargo::cargo_bin("solang");
+
+    assert!(
+        worker.exists(),
+        "{} is needed to run the link workers",
+        worker.display()
+    );
+
+    set_link_worker(worker);
+
+    for ((target, objects), expected) in targets.iter().zip(&objects).zip(&expected) {
+        // link all of them at once, several times over
+        let linked: Vec<Vec<u8>> = thread::scope(|scope| {
+            let threads: Vec<_> = objects
+                .iter()
+                .cycle()
+                .take(objects.len() * 4)
+                .map(|(object, name)| scope.spawn(move || link(object, name, *target, false)))
+                .collect();
+
+            threads
+                .into_iter()
+                .map(|thread| thread.join().unwrap())
+                .collect()
+        });
+
+        for (no, code) in linked.iter().enumerate() {
+            assert_eq!(code, &expected[no % expected.len()]);
+        }
+    }
+
+    assert!(peak_concurrent_links() > 1, "the links did not overlap");
+}
+
+#[test]
+fn in_memory_link_matches_files() {
+    for target in [Target::Solana, Target::default_polkadot()] {
+        for (object, name) in objects(&contracts(2), target) {
+            for min_size in [false, true] {
+                let (in_memory, files) = if target == Target::Solana {
+                    let command_line = bpf::command_line(min_size);
+
+                    (
+                        bpf::link_in_memory(&command_line, &object, &name),
+                        bpf::link_using_files(command_line, &object, &name),
+                    )
+                } else {
+                    let command_line = wasm::command_line(min_size);
+
+                    (
+                        wasm::link_in_memory(&command_line, &object, &name),
+                        wasm::link_using_files(command_line, &object, &name),
+                    )
+                };
+
+                // in-memory linking is not available on every platform
+                if let Some(in_memory) = in_memory {
+                    assert_eq!(in_memory, files);
+                }
+            }
+        }
+    }
+}
+
+fn static_data(len: usize) -> String {
+    format!(
+        "contract c {{
+            function f() public pure returns (string) {{
+                return \"{}\";
+            }}
+        }}",
+        "a".repeat(len)
+    )
+}
+
+#[test]
+fn wasm_static_data_fits() {
+    // the static data and the stack share the first page of memory
+    for (object, name) in objects(&static_data(60000), Target::default_polkadot()) {
+        assert!(!wasm::link(&object, &name, false).is_empty());
+    }
+}
+
+#[test]
+#[should_panic(expected = "bytes of static data, which does not fit in the first 65536 bytes")]
+fn wasm_static_data_too_large() {
+    for (object, name) in objects(&static_data(70000), Target::default_polkadot()) {
+        wasm::link(&object, &name, false);
+    }
+}
@@ -11,19 +11,31 @@ use wasm_encoder::{
 };
 use wasmparser::{Global, Import, Parser, Payload::*, SectionLimited, TypeRef};
 
-pub fn link(input: &[u8], name: &str) -> Vec<u8> {
-    let dir = tempdir().expect("failed to create temp directory for linking");
+/// The first page of memory holds the static data and the stack, see `command_line()`
+const FIRST_PAGE: usize = 0x10000;
 
-    let object_filename = dir.path().join(format!("{name}.o"));
-    let res_filename = dir.path().join(format!("{name}.wasm"));
+pub fn link(input: &[u8], name: &str, min_size: bool) -> Vec<u8> {
+    // Otherwise lld fails because the initial memory is too small, which does not say why
+    let data_size = data_size(input);
 
-    let mut objectfile =
-        File::create(object_filename.clone()).expect("failed to create object file");
+    assert!(
+        data_size <= FIRST_PAGE,
+        "contract {name} has {data_size} bytes of static data, which does not fit in the first \
+         {FIRST_PAGE} bytes of memory with the stack"
+    );
 
-    objectfile
-        .write_all(input)
-        .expect("failed to write object file to temp file");
+    let command_line = command_line(min_size);
+
+    let output = if let Some(output) = link_in_memory(&command_line, input, name) {
+        output
+    } else {
+        link_using_files(command_line, input, name)
+    };
 
+    generate_module(&output)
+}
+
+pub(super) fn command_line(min_size: bool) -> Vec<CString> {
     let mut command_line = vec![
         CString::new("-O3").unwrap(),
         CString::new("--no-entry").unwrap(),
@@ -37,10 +49,51 @@ pub fn link(input: &[u8], name: &str) -> Vec<u8> {
     command_line.push(CString::new("--export").unwrap());
     command_line.push(CString::new("call").unwrap());
 
+    // The first page holds the static data and the stack, and the heap starts in the second
+    // page. The heap grows the memory when it runs out, so start with as little memory as
+    // possible. lld needs the static data and its own stack to fit in the initial memory.
     command_line.push(CString::new("--import-memory").unwrap());
-    command_line.push(CString::new("--initial-memory=1048576").unwrap());
+    command_line.push(CString::new("--initial-memory=131072").unwrap());
     command_line.push(CString::new("--max-memory=1048576").unwrap());
 
+    // wasm-ld always garbage collects per function, and identical functions have already been
+    // merged by codegen, so all that is left is to drop the name and producers sections.
+    if min_size {
+        command_line.push(CString::new("--strip-all").unwrap());
+    }
+
+    command_line
+}
+
+pub(super) fn link_in_memory(
+    command_line: &[CString],
+    input: &[u8],
+    name: &str,
+) -> Option<Vec<u8>> {
+    let object_filename = format!("{name}.o");
+
+    super::wasm_linker_in_memory(command_line, &[(object_filename.as_str(), input)])
+}
+
+/// Fallback for when in-memory linking is not available: write the object file to a
+/// temporary directory, and read the linked result back
+pub(super) fn link_using_files(
+    mut command_line: Vec<CString>,
+    input: &[u8],
+    name: &str,
+) -> Vec<u8> {
+    let dir = tempdir().expect("failed to create temp directory for linking");
+
+    let object_filename = dir.path().join(format!("{name}.o"));
+    let res_filename = dir.path().join(format!("{name}.wasm"));
+
+    let mut objectfile =
+        File::create(object_filename.clone()).expect("failed to create object file");
+
+    objectfile
+        .write_all(input)
+        .expect("failed to write object file to temp file");
+
     command_line.push(
         CString::new(
             object_filename
@@ -63,7 +116,51 @@ pub fn link(input: &[u8], name: &str) -> Vec<u8> {
         .read_to_end(&mut output)
         .expect("failed to read output file");
 
-    generate_module(&output)
+    output
+}
+
+/// The total length of the data segments in an object file, including zero initialized data
+fn data_size(input: &[u8]) -> usize {
+    Parser::new(0)
+        .parse_all(input)
+        .filter_map(|payload| match payload.unwrap() {
+            DataSection(s) => Some(
+                s.into_iter()
+                    .map(|data| data.unwrap().data.len())
+                    .sum::<usize>(),
+            ),
+            _ => None,
+        })
+        .sum()
+}
+
+pub fn section_sizes(code: &[u8]) -> Vec<(String, usize)> {
+    Parser::new(0)
+        .parse_all(code)
+        .map(|s| s.unwrap())
+        .filter_map(|payload| match payload {
+            CustomSection(section) => Some((section.name().to_string(), section.data().len())),
+            _ => payload.as_section().map(|(id, range)| {
+                let name = match id {
+                    1 => "type",
+                    2 => "import",
+                    3 => "function",
+                    4 => "table",
+                    5 => "memory",
+                    6 => "global",
+                    7 => "export",
+                    8 => "start",
+                    9 => "element",
+                    10 => "code",
+                    11 => "data",
+                    12 => "datacount",
+                    _ => "unknown",
+                };
+
+                (name.to_string(), range.len())
+            }),
+        })
+        .collect()
 }
 
 fn generate_module(input: &[u8]) -> Vec<u8> {
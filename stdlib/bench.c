@@ -0,0 +1,591 @@
+// SPDX-License-Identifier: Apache-2.0
+
+// Microbenchmarks for the stdlib, built natively. To run them:
+// make bench
+//
+// Each line of output is comma separated: the benchmark, its parameter (the width of the
+// operands in bits, the length of the buffer in bytes, or the allocation pattern), the
+// number of iterations timed and the nanoseconds per iteration. Compare the output of
+// two builds to find regressions. The host is not the SBF virtual machine, so only
+// compare numbers from the same machine.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "stdlib.h"
+#include "solana_sdk.h"
+
+typedef unsigned _BitInt(256) uint256_t;
+typedef unsigned _BitInt(512) uint512_t;
+
+extern void __mul64(uint32_t left[], uint32_t right[], uint32_t out[]);
+extern void __mul128(uint32_t left[], uint32_t right[], uint32_t out[]);
+extern void __mul256(uint32_t left[], uint32_t right[], uint32_t out[]);
+extern void __mul512(uint32_t left[], uint32_t right[], uint32_t out[]);
+extern int udivmod128(__uint128_t *pdividend, __uint128_t *pdivisor, __uint128_t *remainder, __uint128_t *quotient);
+extern int udivmod256(uint256_t *pdividend, uint256_t *pdivisor, uint256_t *remainder, uint256_t *quotient);
+extern int udivmod512(uint512_t *pdividend, uint512_t *pdivisor, uint512_t *remainder, uint512_t *quotient);
+extern void mulmod256(uint32_t x[], uint32_t y[], uint32_t k[], uint32_t out[]);
+extern void addmod256(uint32_t x[], uint32_t y[], uint32_t k[], uint32_t out[]);
+extern char *uint2dec(char *output, uint64_t val);
+extern char *uint128dec(char *output, __uint128_t val128);
+extern char *uint256dec(char *output, uint256_t *val256);
+extern void hex_encode(char *output, uint8_t *input, uint32_t length);
+extern void ripemd160(void *in, int inlen, void *out);
+extern void __beNtoleN(uint8_t *from, uint8_t *to, uint32_t length);
+extern bool __memcmp(uint8_t *left, uint32_t left_len, uint8_t *right, uint32_t right_len);
+extern uint64_t vector_hash(struct vector *v);
+extern void __init_heap();
+extern uint64_t account_data_alloc(SolAccountInfo *ai, uint32_t size, uint32_t *res);
+extern uint64_t account_data_realloc(SolAccountInfo *ai, uint32_t offset, uint32_t size, uint32_t *res);
+extern void account_data_free(void *data, uint32_t offset);
+
+const uint32_t __heap_size = 256 * 1024;
+
+#define HEAP_START ((void *)0x300000000)
+
+// Iterations are doubled until a run takes at least this long
+#define MIN_NANOSECONDS 50000000
+
+// Results are added up here, so that the compiler cannot drop the work
+static volatile uint64_t sink;
+
+static uint64_t nanoseconds()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Run the benchmark with an increasing number of iterations until the time is measurable
+static void bench(const char *name, const char *param, void (*run)(uint64_t iterations, void *arg), void *arg)
+{
+    uint64_t iterations = 1, elapsed;
+
+    for (;;)
+    {
+        uint64_t start = nanoseconds();
+
+        run(iterations, arg);
+
+        elapsed = nanoseconds() - start;
+
+        if (elapsed >= MIN_NANOSECONDS)
+            break;
+
+        iterations *= 2;
+    }
+
+    printf("%s,%s,%llu,%.2f\n", name, param, (unsigned long long)iterations, (double)elapsed / iterations);
+}
+
+// Operands for the integer benchmarks, as 32 bit limbs. The limbs are accessed in place of
+// the wider integer types, like bigint.c does, so they are aligned like them.
+static uint32_t left[16] __attribute__((aligned(16))), right[16] __attribute__((aligned(16)));
+static uint32_t out[32] __attribute__((aligned(16)));
+static uint32_t modulus[16] __attribute__((aligned(16)));
+
+static void run_mul(uint64_t iterations, void *arg)
+{
+    void (*mul)(uint32_t[], uint32_t[], uint32_t[]) = arg;
+
+    while (iterations--)
+    {
+        left[0]++;
+        mul(left, right, out);
+        sink += out[0];
+    }
+}
+
+// The dividend has all its bits, the divisor half of them; this is the long division
+static void run_udivmod(uint64_t iterations, void *arg)
+{
+    int bits = *(int *)arg;
+    uint32_t remainder[16] __attribute__((aligned(16))), quotient[16] __attribute__((aligned(16)));
+
+    while (iterations--)
+    {
+        left[0]++;
+
+        switch (bits)
+        {
+        case 64:
+        case 128:
+            udivmod128((__uint128_t *)left, (__uint128_t *)right, (__uint128_t *)remainder, (__uint128_t *)quotient);
+            break;
+        case 256:
+            udivmod256((uint256_t *)left, (uint256_t *)right, (uint256_t *)remainder, (uint256_t *)quotient);
+            break;
+        case 512:
+            udivmod512((uint512_t *)left, (uint512_t *)right, (uint512_t *)remainder, (uint512_t *)quotient);
+            break;
+        }
+
+        sink += quotient[0];
+    }
+}
+
+static void run_modular(uint64_t iterations, void *arg)
+{
+    void (*op)(uint32_t[], uint32_t[], uint32_t[], uint32_t[]) = arg;
+
+    while (iterations--)
+    {
+        left[0]++;
+        op(left, right, modulus, out);
+        sink += out[0];
+    }
+}
+
+static void run_format_dec(uint64_t iterations, void *arg)
+{
+    int bits = *(int *)arg;
+    char output[160];
+
+    while (iterations--)
+    {
+        left[0]++;
+
+        char *end;
+        uint64_t val64;
+        __uint128_t val128;
+
+        switch (bits)
+        {
+        case 64:
+            memcpy(&val64, left, sizeof(val64));
+            end = uint2dec(output, val64);
+            break;
+        case 128:
+            memcpy(&val128, left, sizeof(val128));
+            end = uint128dec(output, val128);
+            break;
+        default:
+            end = uint256dec(output, (uint256_t *)left);
+            break;
+        }
+
+        sink += end - output;
+    }
+}
+
+// Convert a big endian integer, like a hash or a bytesN cast does
+static void run_be_to_le(uint64_t iterations, void *arg)
+{
+    int bits = *(int *)arg;
+
+    while (iterations--)
+    {
+        left[0]++;
+        __beNtoleN((uint8_t *)left, (uint8_t *)out, bits / 8);
+        sink += out[0];
+    }
+}
+
+// Set the lowest bits bits of the limbs to random values, and clear the rest
+static void random_limbs(uint32_t limbs[16], int bits)
+{
+    for (int i = 0; i < 16; i++)
+        limbs[i] = i < bits / 32 ? (uint32_t)rand() << 1 ^ rand() : 0;
+}
+
+static void bench_integers()
+{
+    void (*muls[])(uint32_t[], uint32_t[], uint32_t[]) = {__mul64, __mul128, __mul256, __mul512};
+    char param[16];
+
+    for (int i = 0, bits = 64; bits <= 512; i++, bits *= 2)
+    {
+        snprintf(param, sizeof(param), "%d", bits);
+
+        random_limbs(left, bits);
+        random_limbs(right, bits);
+        bench("mul", param, run_mul, muls[i]);
+
+        // udivmod128 takes the 64 bit fast path when both operands fit
+        random_limbs(left, bits);
+        random_limbs(right, bits / 2);
+        bench("udivmod", param, run_udivmod, &bits);
+
+        if (bits <= 256)
+        {
+            random_limbs(left, bits);
+            bench("format_dec", param, run_format_dec, &bits);
+            bench("be_to_le", param, run_be_to_le, &bits);
+        }
+
+        // As in curve arithmetic, the operands are reduced and the modulus has all its bits
+        if (bits == 256)
+        {
+            random_limbs(left, bits);
+            random_limbs(right, bits);
+            random_limbs(modulus, bits);
+            left[7] &= 0x7fffffff;
+            right[7] &= 0x7fffffff;
+            modulus[7] |= 0x80000000;
+            bench("mulmod", param, run_modular, mulmod256);
+            bench("addmod", param, run_modular, addmod256);
+        }
+    }
+}
+
+static const uint32_t lengths[] = {8, 32, 64, 256, 1024, 4096};
+
+struct buffers
+{
+    uint8_t *a, *b;
+    char *text;
+    struct vector *v;
+    uint32_t length;
+};
+
+static void run_memcpy(uint64_t iterations, void *arg)
+{
+    struct buffers *buf = arg;
+
+    while (iterations--)
+    {
+        __memcpy(buf->a, buf->b, buf->length);
+        sink += buf->a[0];
+    }
+}
+
+static void run_memset(uint64_t iterations, void *arg)
+{
+    struct buffers *buf = arg;
+
+    while (iterations--)
+    {
+        __memset(buf->a, iterations, buf->length);
+        sink += buf->a[0];
+    }
+}
+
+// The buffers are equal, which is the worst case
+static void run_memcmp(uint64_t iterations, void *arg)
+{
+    struct buffers *buf = arg;
+
+    while (iterations--)
+        sink += __memcmp(buf->a, buf->length, buf->b, buf->length);
+}
+
+static void run_vector_hash(uint64_t iterations, void *arg)
+{
+    struct buffers *buf = arg;
+
+    while (iterations--)
+        sink += vector_hash(buf->v);
+}
+
+static void run_hex_encode(uint64_t iterations, void *arg)
+{
+    struct buffers *buf = arg;
+
+    while (iterations--)
+    {
+        hex_encode(buf->text, buf->a, buf->length);
+        sink += buf->text[0];
+    }
+}
+
+static void run_ripemd160(uint64_t iterations, void *arg)
+{
+    struct buffers *buf = arg;
+    uint8_t hash[20];
+
+    while (iterations--)
+    {
+        ripemd160(buf->a, buf->length, hash);
+        sink += hash[0];
+    }
+}
+
+static void bench_buffers()
+{
+    struct buffers buf;
+    char param[16];
+
+    buf.a = malloc(4096);
+    buf.b = malloc(4096);
+    buf.text = malloc(2 * 4096);
+    buf.v = malloc(sizeof(struct vector) + 4096);
+
+    for (int i = 0; i < 4096; i++)
+        buf.a[i] = buf.b[i] = buf.v->data[i] = rand();
+
+    for (int i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+    {
+        buf.length = buf.v->len = buf.v->size = lengths[i];
+
+        snprintf(param, sizeof(param), "%u", lengths[i]);
+
+        // memcpy leaves the buffers equal for memcmp, so memset goes last
+        bench("memcpy", param, run_memcpy, &buf);
+        bench("memcmp", param, run_memcmp, &buf);
+        bench("vector_hash", param, run_vector_hash, &buf);
+        bench("hex_encode", param, run_hex_encode, &buf);
+        bench("ripemd160", param, run_ripemd160, &buf);
+        bench("memset", param, run_memset, &buf);
+    }
+
+    free(buf.a);
+    free(buf.b);
+    free(buf.text);
+    free(buf.v);
+}
+
+#define OBJECTS 64
+
+// Allocate objects and free them in the same order
+static void run_heap_fifo(uint64_t iterations, void *arg)
+{
+    void *objects[OBJECTS];
+
+    while (iterations--)
+    {
+        __init_heap();
+
+        for (int i = 0; i < OBJECTS; i++)
+            objects[i] = __malloc(32 + i % 8 * 8);
+
+        for (int i = 0; i < OBJECTS; i++)
+            __free(objects[i]);
+    }
+}
+
+// Allocate objects and free them in the opposite order, like a stack
+static void run_heap_lifo(uint64_t iterations, void *arg)
+{
+    void *objects[OBJECTS];
+
+    while (iterations--)
+    {
+        __init_heap();
+
+        for (int i = 0; i < OBJECTS; i++)
+            objects[i] = __malloc(32 + i % 8 * 8);
+
+        for (int i = OBJECTS - 1; i >= 0; i--)
+            __free(objects[i]);
+    }
+}
+
+// Grow a vector a few bytes at a time, like push() on a memory array
+static void run_heap_push(uint64_t iterations, void *arg)
+{
+    while (iterations--)
+    {
+        __init_heap();
+
+        void *other = NULL, *v = __malloc(8);
+
+        for (uint32_t length = 16; length <= 2048; length += 8)
+        {
+            v = __realloc(v, length);
+
+            // something else is allocated now and then, so the vector cannot always grow in place
+            if (length % 256 == 0)
+            {
+                __free(other);
+                other = __malloc(64);
+            }
+        }
+
+        sink += (uintptr_t)v;
+    }
+}
+
+// Random sizes, random frees; the pattern is the same on each iteration
+static void run_heap_random(uint64_t iterations, void *arg)
+{
+    void *objects[OBJECTS];
+
+    while (iterations--)
+    {
+        uint32_t seed = 1;
+
+        __init_heap();
+        memset(objects, 0, sizeof(objects));
+
+        for (int step = 0; step < 1000; step++)
+        {
+            seed = seed * 1103515245 + 12345;
+
+            int n = (seed >> 16) % OBJECTS;
+
+            if (objects[n])
+            {
+                __free(objects[n]);
+                objects[n] = NULL;
+            }
+            else
+            {
+                objects[n] = __malloc((seed >> 8) % 512);
+            }
+        }
+
+        sink += (uintptr_t)objects[0];
+    }
+}
+
+static void bench_heap()
+{
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE;
+    void *heap = mmap(HEAP_START, __heap_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+
+    if (heap != HEAP_START)
+    {
+        perror("cannot map the heap");
+        exit(1);
+    }
+
+    bench("heap", "fifo", run_heap_fifo, NULL);
+    bench("heap", "lifo", run_heap_lifo, NULL);
+    bench("heap", "push", run_heap_push, NULL);
+    bench("heap", "random", run_heap_random, NULL);
+}
+
+// An account laid out like the serialized input, so that the account data can grow
+struct account
+{
+    uint64_t *input;
+    SolAccountInfo ai;
+};
+
+#define ACCOUNT_DATA_LENGTH 0x100
+#define ACCOUNT_HEAP_OFFSET 0x20
+
+// Start with an empty account heap, as the constructor leaves it
+static void account_reset(struct account *account)
+{
+    uint8_t *data = (uint8_t *)account->input + 88;
+
+    account->ai.key = (SolPubkey *)(data - 80);
+    account->ai.data = data;
+    account->ai.data_len = ACCOUNT_DATA_LENGTH;
+    account->ai.is_writable = true;
+    ((uint32_t *)account->ai.key)[-1] = ACCOUNT_DATA_LENGTH;
+    ((uint64_t *)data)[-1] = ACCOUNT_DATA_LENGTH;
+
+    // magic, heap_last, heap_free and heap_offset
+    uint32_t *hdr = (uint32_t *)data;
+
+    hdr[0] = 0x41424344;
+    hdr[1] = 0;
+    hdr[2] = 0;
+    hdr[3] = ACCOUNT_HEAP_OFFSET;
+
+    // the heap only looks at the data past its last entry when it grows
+    memset(data + 16, 0, ACCOUNT_DATA_LENGTH - 16);
+}
+
+// Random allocations, reallocations and frees, like storage of strings and dynamic arrays
+static void run_account_random(uint64_t iterations, void *arg)
+{
+    struct account *account = arg;
+    uint32_t offsets[OBJECTS];
+
+    while (iterations--)
+    {
+        uint32_t seed = 1;
+
+        account_reset(account);
+        memset(offsets, 0, sizeof(offsets));
+
+        for (int step = 0; step < 1000; step++)
+        {
+            seed = seed * 1103515245 + 12345;
+
+            int n = (seed >> 16) % OBJECTS;
+
+            if (!offsets[n])
+            {
+                account_data_alloc(&account->ai, 100, &offsets[n]);
+            }
+            else if (seed & 0x100)
+            {
+                account_data_free(account->ai.data, offsets[n]);
+                offsets[n] = 0;
+            }
+            else
+            {
+                account_data_realloc(&account->ai, offsets[n], (seed >> 8) % 200 + 10, &offsets[n]);
+            }
+        }
+
+        sink += offsets[0];
+    }
+}
+
+// Grow one object, like push() on a storage bytes
+static void run_account_push(uint64_t iterations, void *arg)
+{
+    struct account *account = arg;
+
+    while (iterations--)
+    {
+        uint32_t offset = 0;
+
+        account_reset(account);
+
+        for (uint32_t length = 1; length <= 1024; length++)
+            account_data_realloc(&account->ai, offset, length, &offset);
+
+        sink += offset;
+    }
+}
+
+static void bench_account()
+{
+    struct account account;
+
+    account.input = calloc(1, 88 + ACCOUNT_DATA_LENGTH + MAX_PERMITTED_DATA_INCREASE);
+
+    bench("account_heap", "random", run_account_random, &account);
+    bench("account_heap", "push", run_account_push, &account);
+
+    free(account.input);
+}
+
+int main()
+{
+    srand(102);
+
+    printf("benchmark,parameter,iterations,ns_per_iteration\n");
+
+    bench_integers();
+    bench_buffers();
+    bench_heap();
+    bench_account();
+
+    return 0;
+}
+
+// solana.c has an entrypoint, which is never called here
+uint64_t solang_dispatch(SolParameters *param)
+{
+    return 0;
+}
+
+uint64_t sol_invoke_signed_c(const SolInstruction *instruction, const SolAccountInfo *account_infos,
+                             int account_infos_len, const SolSignerSeeds *signers_seeds, int signers_seeds_len)
+{
+    return 0;
+}
+
+void sol_log_pubkey(const SolPubkey *pubkey)
+{
+}
+
+void sol_panic_(const char *s, uint64_t len, uint64_t line, uint64_t column)
+{
+    printf("panic: %s line %llu\n", s, (unsigned long long)line);
+    abort();
+}
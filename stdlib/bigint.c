@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "profile.h"
 
 /*
     In wasm/bpf, the instruction for multiplying two 64 bit values results in a 64 bit value. In
@@ -117,6 +118,117 @@ bool __mul32_with_builtin_ovf(uint32_t left[], uint32_t right[], uint32_t out[],
     return overflow;
 }
 
+// Fixed width multiply kernels.
+//
+// These compute the same result as __mul32(), but the number of limbs is known at compile
+// time so clang unrolls every loop. The product is formed column by column (Comba): all the
+// partial products which land in a column are summed into a 96 bit accumulator, the low 32 bits
+// are stored, and the accumulator is shifted down by 32 bits for the next column. Partial
+// products which land beyond the width of the result are never computed.
+static inline __attribute__((always_inline)) uint64_t mul_columns(uint32_t left[], uint32_t right[], uint32_t out[],
+                                                                  const int len)
+{
+    uint64_t acc = 0, carry = 0;
+
+#pragma clang loop unroll(full)
+    for (int col = 0; col < len; col++)
+    {
+#pragma clang loop unroll(full)
+        for (int l = 0; l <= col; l++)
+        {
+            uint64_t m = (uint64_t)left[l] * (uint64_t)right[col - l];
+
+            acc += m;
+            carry += acc < m;
+        }
+
+        out[col] = acc;
+
+        acc = (acc >> 32) | (carry << 32);
+        carry = 0;
+    }
+
+    // carry into the column after the last
+    return acc;
+}
+
+// Number of significant bits in a value of len limbs
+static inline __attribute__((always_inline)) int bit_length(uint32_t v[], const int len)
+{
+#pragma clang loop unroll(full)
+    for (int i = len - 1; i >= 0; i--)
+    {
+        if (v[i])
+            return i * 32 + 32 - __builtin_clz(v[i]);
+    }
+
+    return 0;
+}
+
+// Multiply with overflow detection. The product of an a bit value and a b bit value has either
+// a + b - 1 or a + b bits. So, if a + b is more than one bit larger than the result there
+// is an overflow, and if a + b fits there is not; there is no need to compute the upper half of
+// the product. Only when a + b is exactly one bit too large does the carry out of the top
+// column decide. In that case the top limbs of both operands are at most len - 1 when added, so
+// there are no partial products beyond the top column.
+static inline __attribute__((always_inline)) bool mul_columns_ovf(uint32_t left[], uint32_t right[], uint32_t out[],
+                                                                  const int len)
+{
+    int bits = bit_length(left, len) + bit_length(right, len);
+
+    if (bits > len * 32 + 1)
+    {
+        // do not leave the result uninitialized
+#pragma clang loop unroll(full)
+        for (int i = 0; i < len; i++)
+            out[i] = 0;
+
+        return true;
+    }
+
+    return mul_columns(left, right, out, len) != 0;
+}
+
+void __mul64(uint32_t left[], uint32_t right[], uint32_t out[])
+{
+    mul_columns(left, right, out, 2);
+}
+
+void __mul128(uint32_t left[], uint32_t right[], uint32_t out[])
+{
+    mul_columns(left, right, out, 4);
+}
+
+void __mul256(uint32_t left[], uint32_t right[], uint32_t out[])
+{
+    mul_columns(left, right, out, 8);
+}
+
+void __mul512(uint32_t left[], uint32_t right[], uint32_t out[])
+{
+    mul_columns(left, right, out, 16);
+}
+
+bool __mul64_with_ovf(uint32_t left[], uint32_t right[], uint32_t out[])
+{
+    return mul_columns_ovf(left, right, out, 2);
+}
+
+bool __mul128_with_ovf(uint32_t left[], uint32_t right[], uint32_t out[])
+{
+    return mul_columns_ovf(left, right, out, 4);
+}
+
+bool __mul256_with_ovf(uint32_t left[], uint32_t right[], uint32_t out[])
+{
+    return mul_columns_ovf(left, right, out, 8);
+}
+
+bool __mul512_with_ovf(uint32_t left[], uint32_t right[], uint32_t out[])
+{
+    return mul_columns_ovf(left, right, out, 16);
+}
+
 // Some compiler runtime builtins we need.
 
 // 128 bit shift left.
@@ -225,63 +337,6 @@ __uint128_t __ashrti3(__uint128_t val, int r)
     return result.all;
 }
 
-// Return the highest set bit in v
-int bits(uint64_t v)
-{
-    int h = 63;
-
-    if (!(v & 0xffffffff00000000))
-    {
-        h -= 32;
-        v <<= 32;
-    }
-
-    if (!(v & 0xffff000000000000))
-    {
-        h -= 16;
-        v <<= 16;
-    }
-
-    if (!(v & 0xff00000000000000))
-    {
-        h -= 8;
-        v <<= 8;
-    }
-
-    if (!(v & 0xf000000000000000))
-    {
-        h -= 4;
-        v <<= 4;
-    }
-
-    if (!(v & 0xc000000000000000))
-    {
-        h -= 2;
-        v <<= 2;
-    }
-
-    if (!(v & 0x8000000000000000))
-    {
-        h -= 1;
-    }
-
-    return h;
-}
-
-int bits128(__uint128_t v)
-{
-    uint64_t upper = v >> 64;
-
-    if (upper)
-    {
-        return bits(upper) + 64;
-    }
-    else
-    {
-        return bits(v);
-    }
-}
-
 __uint128_t shl128(__uint128_t val, int r)
 {
     if (r == 0)
@@ -336,56 +391,168 @@ __uint128_t shr128(__uint128_t val, int r)
     }
 }
 
-int udivmod128(__uint128_t *pdividend, __uint128_t *pdivisor, __uint128_t *remainder, __uint128_t *quotient)
+// Long division of little endian 32 bit limbs, using Knuth's Algorithm D (The Art of Computer
+// Programming, volume 2, section 4.3.1). Each quotient digit is estimated from the top two limbs
+// of the remainder and the top limb of the normalized divisor, which is at most two too large;
+// the estimate is corrected with the next limb and, rarely, by adding back the divisor.
+//
+// The work is done on the significant limbs only, so small values are cheap regardless of the
+// width of the type. Values which fit in 64 bits and single limb divisors have their own fast
+// paths using the native 64 bit division. divisor must not be zero.
+#define MAX_LIMBS 16
+
+// The limbs are accessed in place of wider integer types
+typedef uint32_t __attribute__((may_alias)) limb;
+
+static void divmod_limbs(limb pdividend[], limb pdivisor[], limb remainder[], limb quotient[], int len)
 {
-    __uint128_t dividend = *pdividend;
-    __uint128_t divisor = *pdivisor;
+    int m = len, n = len;
 
-    if (divisor == 0)
-        return 1;
+    while (m > 0 && !pdividend[m - 1])
+        m--;
+
+    while (!pdivisor[n - 1])
+        n--;
 
-    if (divisor == 1)
+    PROFILE(PROFILE_DIVMOD, m);
+
+    // The remainder or quotient may be the same memory as the dividend or divisor, so take a copy
+    // of them before the results are written
+    uint32_t dividend[MAX_LIMBS], divisor[MAX_LIMBS];
+
+    for (int i = 0; i < m; i++)
+        dividend[i] = pdividend[i];
+
+    for (int i = 0; i < n; i++)
+        divisor[i] = pdivisor[i];
+
+    for (int i = 0; i < len; i++)
     {
-        *remainder = 0;
-        *quotient = dividend;
-        return 0;
+        quotient[i] = 0;
+        remainder[i] = 0;
     }
 
-    if (divisor == dividend)
+    if (m < n)
     {
-        *remainder = 0;
-        *quotient = 1;
-        return 0;
+        for (int i = 0; i < m; i++)
+            remainder[i] = dividend[i];
+
+        return;
     }
 
-    if (dividend == 0 || dividend < divisor)
+    if (m <= 2)
     {
-        *remainder = dividend;
-        *quotient = 0;
-        return 0;
+        uint64_t u = dividend[0] | (m > 1 ? (uint64_t)dividend[1] << 32 : 0);
+        uint64_t v = divisor[0] | (n > 1 ? (uint64_t)divisor[1] << 32 : 0);
+        uint64_t q = u / v, r = u - q * v;
+
+        quotient[0] = q;
+        quotient[1] = q >> 32;
+        remainder[0] = r;
+        remainder[1] = r >> 32;
+
+        return;
     }
 
-    __uint128_t q = 0, r = 0;
+    if (n == 1)
+    {
+        uint64_t v = divisor[0], r = 0;
+
+        for (int i = m - 1; i >= 0; i--)
+        {
+            uint64_t u = (r << 32) | dividend[i];
+            uint64_t q = u / v;
+
+            PROFILE_LOOP(PROFILE_DIVMOD);
+
+            quotient[i] = q;
+            r = u - q * v;
+        }
+
+        remainder[0] = r;
+
+        return;
+    }
+
+    // Normalize so that the top bit of the divisor is set; this keeps the estimates close
+    uint32_t u[MAX_LIMBS + 1], v[MAX_LIMBS];
+    int s = __builtin_clz(divisor[n - 1]);
 
-    for (int x = bits128(dividend) + 1; x > 0; x--)
+    for (int i = n - 1; i > 0; i--)
+        v[i] = (divisor[i] << s) | ((uint64_t)divisor[i - 1] >> (32 - s));
+    v[0] = divisor[0] << s;
+
+    u[m] = (uint64_t)dividend[m - 1] >> (32 - s);
+    for (int i = m - 1; i > 0; i--)
+        u[i] = (dividend[i] << s) | ((uint64_t)dividend[i - 1] >> (32 - s));
+    u[0] = dividend[0] << s;
+
+    for (int j = m - n; j >= 0; j--)
     {
-        q <<= 1;
-        r <<= 1;
+        uint64_t top = ((uint64_t)u[j + n] << 32) | u[j + n - 1];
+        uint64_t qhat = top / v[n - 1];
+        uint64_t rhat = top - qhat * v[n - 1];
+
+        PROFILE_LOOP(PROFILE_DIVMOD);
+
+        while (qhat >> 32 || qhat * v[n - 2] > ((rhat << 32) | u[j + n - 2]))
+        {
+            qhat--;
+            rhat += v[n - 1];
+
+            if (rhat >> 32)
+                break;
+        }
+
+        // Multiply and subtract
+        uint64_t carry = 0, borrow = 0;
 
-        if ((dividend >> (x - 1)) & 1)
+        for (int i = 0; i < n; i++)
         {
-            r++;
+            uint64_t p = qhat * v[i] + carry;
+            uint64_t t = (uint64_t)u[i + j] - (uint32_t)p - borrow;
+
+            carry = p >> 32;
+            u[i + j] = t;
+            borrow = (t >> 32) & 1;
         }
 
-        if (r >= divisor)
+        uint64_t t = (uint64_t)u[j + n] - carry - borrow;
+
+        u[j + n] = t;
+
+        if (t >> 63)
         {
-            r -= divisor;
-            q++;
+            // The estimate was one too large; add the divisor back
+            qhat--;
+            carry = 0;
+
+            for (int i = 0; i < n; i++)
+            {
+                uint64_t sum = (uint64_t)u[i + j] + v[i] + carry;
+
+                u[i + j] = sum;
+                carry = sum >> 32;
+            }
+
+            u[j + n] += carry;
         }
+
+        quotient[j] = qhat;
     }
 
-    *quotient = q;
-    *remainder = r;
+    // Undo the normalization of the remainder
+    for (int i = 0; i < n - 1; i++)
+        remainder[i] = (u[i] >> s) | ((uint64_t)u[i + 1] << (32 - s));
+    remainder[n - 1] = u[n - 1] >> s;
+}
+
+int udivmod128(__uint128_t *pdividend, __uint128_t *pdivisor, __uint128_t *remainder, __uint128_t *quotient)
+{
+    if (*pdivisor == 0)
+        return 1;
+
+    divmod_limbs((limb *)pdividend, (limb *)pdivisor, (limb *)remainder, (limb *)quotient, 4);
 
     return 0;
 }
@@ -430,76 +597,13 @@ int sdivmod128(__uint128_t *pdividend, __uint128_t *pdivisor, __uint128_t *remai
 
 typedef unsigned _BitInt(256) uint256_t;
 uint256_t const uint256_0 = (uint256_t)0;
-uint256_t const uint256_1 = (uint256_t)1;
-
-int bits256(uint256_t *value)
-{
-    // 256 bits values consist of 4 uint64_ts.
-    uint64_t *v = (uint64_t *)value;
-
-    for (int i = 3; i >= 0; i--)
-    {
-        if (v[i])
-            return bits(v[i]) + 64 * i;
-    }
-
-    return 0;
-}
 
 int udivmod256(uint256_t *pdividend, uint256_t *pdivisor, uint256_t *remainder, uint256_t *quotient)
 {
-    uint256_t dividend = *pdividend;
-    uint256_t divisor = *pdivisor;
-
-    if (divisor == uint256_0)
+    if (*pdivisor == uint256_0)
         return 1;
 
-    if (divisor == uint256_1)
-    {
-        *remainder = uint256_0;
-        *quotient = dividend;
-        return 0;
-    }
-
-    if (divisor == dividend)
-    {
-        *remainder = uint256_0;
-        *quotient = uint256_1;
-        return 0;
-    }
-
-    if (dividend == uint256_0 || dividend < divisor)
-    {
-        *remainder = dividend;
-        *quotient = uint256_0;
-        return 0;
-    }
-
-    uint256_t q = uint256_0, r = dividend;
-
-    uint256_t copyd = divisor << (bits256(&dividend) - bits256(&divisor));
-    uint256_t adder = uint256_1 << (bits256(&dividend) - bits256(&divisor));
-
-    if (copyd > dividend)
-    {
-        copyd >>= 1;
-        adder >>= 1;
-    }
-
-    while (r >= divisor)
-    {
-        if (r >= copyd)
-        {
-            r -= copyd;
-            q |= adder;
-        }
-
-        copyd >>= 1;
-        adder >>= 1;
-    }
-
-    *quotient = q;
-    *remainder = r;
+    divmod_limbs((limb *)pdividend, (limb *)pdivisor, (limb *)remainder, (limb *)quotient, 8);
 
     return 0;
 }
@@ -542,78 +646,112 @@ int sdivmod256(uint256_t *pdividend, uint256_t *pdivisor, uint256_t *remainder,
     return 0;
 }
 
-typedef unsigned _BitInt(512) uint512_t;
-uint512_t const uint512_0 = (uint512_t)0;
-uint512_t const uint512_1 = (uint512_t)1;
-
-int bits512(uint512_t *value)
+// Solidity mulmod() and addmod(). The product or sum is formed at its full width and reduced
+// with a single long division, instead of zero extending all the operands to 512 bits for
+// __mul512() and udivmod512(). Barrett or Montgomery reduction only pay off when the reciprocal
+// of the modulus is reused, and finding it costs a long division of its own. The modulus must
+// not be zero; codegen checks this before calling.
+void mulmod256(uint32_t x[], uint32_t y[], uint32_t k[], uint32_t out[])
 {
-    // 512 bits values consist of 8 uint64_ts.
-    uint64_t *v = (uint64_t *)value;
+    uint32_t product[16], divisor[16], remainder[16], quotient[16];
 
-    for (int i = 7; i >= 0; i--)
+    for (int i = 0; i < 16; i++)
     {
-        if (v[i])
-            return bits(v[i]) + 64 * i;
+        product[i] = 0;
+        divisor[i] = i < 8 ? k[i] : 0;
     }
 
-    return 0;
-}
+    // Schoolbook; unlike mul_columns(), this keeps the upper half of the product
+    for (int i = 0; i < 8; i++)
+    {
+        uint64_t carry = 0;
 
-int udivmod512(uint512_t *pdividend, uint512_t *pdivisor, uint512_t *remainder, uint512_t *quotient)
-{
-    uint512_t dividend = *pdividend;
-    uint512_t divisor = *pdivisor;
+#pragma clang loop unroll(full)
+        for (int j = 0; j < 8; j++)
+        {
+            uint64_t t = (uint64_t)x[i] * y[j] + product[i + j] + carry;
 
-    if (divisor == uint512_0)
-        return 1;
+            product[i + j] = t;
+            carry = t >> 32;
+        }
 
-    if (divisor == uint512_1)
-    {
-        *remainder = uint512_0;
-        *quotient = dividend;
-        return 0;
+        product[i + 8] = carry;
     }
 
-    if (divisor == dividend)
-    {
-        *remainder = uint512_0;
-        *quotient = uint512_1;
-        return 0;
-    }
+    divmod_limbs(product, divisor, remainder, quotient, 16);
+
+    for (int i = 0; i < 8; i++)
+        out[i] = remainder[i];
+}
 
-    if (dividend == uint512_0 || dividend < divisor)
+// Compare two values of len limbs
+static inline int compare_limbs(uint32_t a[], uint32_t b[], int len)
+{
+    for (int i = len - 1; i >= 0; i--)
     {
-        *remainder = dividend;
-        *quotient = uint512_0;
-        return 0;
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
     }
 
-    uint512_t q = uint512_0, r = dividend;
+    return 0;
+}
 
-    uint512_t copyd = divisor << (bits512(&dividend) - bits512(&divisor));
-    uint512_t adder = uint512_1 << (bits512(&dividend) - bits512(&divisor));
+void addmod256(uint32_t x[], uint32_t y[], uint32_t k[], uint32_t out[])
+{
+    uint32_t sum[9], divisor[9], remainder[9], quotient[9];
+    uint64_t carry = 0;
 
-    if (copyd > dividend)
+    for (int i = 0; i < 8; i++)
     {
-        copyd >>= 1;
-        adder >>= 1;
+        carry += (uint64_t)x[i] + y[i];
+        sum[i] = carry;
+        carry >>= 32;
     }
 
-    while (r >= divisor)
+    sum[8] = carry;
+
+    for (int i = 0; i < 8; i++)
+        divisor[i] = k[i];
+    divisor[8] = 0;
+
+    // When both operands are already reduced, the sum is less than twice the modulus, so at most
+    // one subtraction is needed. This is the usual case in modular arithmetic.
+    if (compare_limbs(x, k, 8) < 0 && compare_limbs(y, k, 8) < 0)
     {
-        if (r >= copyd)
+        if (compare_limbs(sum, divisor, 9) >= 0)
         {
-            r -= copyd;
-            q |= adder;
+            uint64_t borrow = 0;
+
+            for (int i = 0; i < 8; i++)
+            {
+                uint64_t t = (uint64_t)sum[i] - k[i] - borrow;
+
+                sum[i] = t;
+                borrow = (t >> 32) & 1;
+            }
         }
 
-        copyd >>= 1;
-        adder >>= 1;
+        for (int i = 0; i < 8; i++)
+            out[i] = sum[i];
+
+        return;
     }
 
-    *quotient = q;
-    *remainder = r;
+    divmod_limbs(sum, divisor, remainder, quotient, 9);
+
+    for (int i = 0; i < 8; i++)
+        out[i] = remainder[i];
+}
+
+typedef unsigned _BitInt(512) uint512_t;
+uint512_t const uint512_0 = (uint512_t)0;
+
+int udivmod512(uint512_t *pdividend, uint512_t *pdivisor, uint512_t *remainder, uint512_t *quotient)
+{
+    if (*pdivisor == uint512_0)
+        return 1;
+
+    divmod_limbs((limb *)pdividend, (limb *)pdivisor, (limb *)remainder, (limb *)quotient, 16);
 
     return 0;
 }
@@ -655,3 +793,276 @@ int sdivmod512(uint512_t *pdividend, uint512_t *pdivisor, uint512_t *remainder,
 
     return 0;
 }
+
+#ifdef TEST
+// Check the multiply kernels and their overflow flags against a schoolbook product, and the
+// division against a bit at a time long division
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static uint32_t random_limb()
+{
+    switch (rand() % 4)
+    {
+    case 0:
+        return 0;
+    case 1:
+        return ~0u;
+    default:
+        return (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+    }
+}
+
+// Fill v with a random value of len limbs which has exactly the given number of significant bits
+static void random_limbs(uint32_t v[], int len, int bits)
+{
+    for (int i = 0; i < len; i++)
+    {
+        int limb_bits = bits - i * 32;
+
+        if (limb_bits <= 0)
+            v[i] = 0;
+        else if (limb_bits > 32)
+            v[i] = random_limb();
+        else
+            v[i] = (random_limb() & (~0u >> (32 - limb_bits))) | (1u << (limb_bits - 1));
+    }
+}
+
+// The full product of two values of len limbs, which is 2 * len limbs
+static void reference_mul(uint32_t left[], uint32_t right[], uint32_t product[], int len)
+{
+    for (int i = 0; i < len * 2; i++)
+        product[i] = 0;
+
+    for (int i = 0; i < len; i++)
+    {
+        uint64_t carry = 0;
+
+        for (int j = 0; j < len; j++)
+        {
+            uint64_t t = (uint64_t)left[i] * right[j] + product[i + j] + carry;
+
+            product[i + j] = t;
+            carry = t >> 32;
+        }
+
+        product[i + len] = carry;
+    }
+}
+
+static void test_mul()
+{
+    static const struct
+    {
+        int len;
+        void (*mul)(uint32_t[], uint32_t[], uint32_t[]);
+        bool (*mul_with_ovf)(uint32_t[], uint32_t[], uint32_t[]);
+    } kernels[] = {
+        {2, __mul64, __mul64_with_ovf},
+        {4, __mul128, __mul128_with_ovf},
+        {8, __mul256, __mul256_with_ovf},
+        {16, __mul512, __mul512_with_ovf},
+    };
+
+    for (int k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+    {
+        int len = kernels[k].len, width = len * 32;
+        uint32_t left[16], right[16], out[16], product[32];
+
+        for (int round = 0; round < 100000; round++)
+        {
+            int left_bits = rand() % (width + 1);
+            // The carry out of the top column decides the overflow when the lengths of the operands
+            // add up to one bit more than the width, so most of the time stay close to that
+            int right_bits = rand() % 4 ? width + 1 - left_bits + rand() % 3 - 1 : rand() % (width + 1);
+
+            if (right_bits < 0)
+                right_bits = 0;
+            if (right_bits > width)
+                right_bits = width;
+
+            random_limbs(left, len, left_bits);
+            random_limbs(right, len, right_bits);
+            reference_mul(left, right, product, len);
+
+            bool overflow = false;
+
+            for (int i = len; i < len * 2; i++)
+                overflow |= product[i] != 0;
+
+            kernels[k].mul(left, right, out);
+            assert(!memcmp(out, product, len * 4));
+
+            assert(kernels[k].mul_with_ovf(left, right, out) == overflow);
+            assert(overflow || !memcmp(out, product, len * 4));
+        }
+
+        // Powers of two whose product is the top bit of the result, or one bit beyond it
+        for (int bit = 0; bit < width; bit++)
+        {
+            memset(left, 0, sizeof(left));
+            memset(right, 0, sizeof(right));
+            left[bit / 32] = 1u << (bit % 32);
+            right[(width - 1 - bit) / 32] = 1u << ((width - 1 - bit) % 32);
+
+            assert(!kernels[k].mul_with_ovf(left, right, out));
+            assert(out[len - 1] == 0x80000000);
+
+            if (bit > 0)
+            {
+                memset(right, 0, sizeof(right));
+                right[(width - bit) / 32] = 1u << ((width - bit) % 32);
+
+                assert(kernels[k].mul_with_ovf(left, right, out));
+            }
+        }
+
+        // The largest value times one, two and itself
+        memset(left, 0xff, sizeof(left));
+        memset(right, 0, sizeof(right));
+        right[0] = 1;
+        assert(!kernels[k].mul_with_ovf(left, right, out));
+        assert(!memcmp(out, left, len * 4));
+
+        right[0] = 2;
+        assert(kernels[k].mul_with_ovf(left, right, out));
+
+        kernels[k].mul(left, left, out);
+        assert(out[0] == 1);
+        for (int i = 1; i < len; i++)
+            assert(out[i] == 0);
+        assert(kernels[k].mul_with_ovf(left, left, out));
+    }
+}
+
+// The quotient and remainder of values of len limbs, a bit at a time
+static void reference_divmod(uint32_t dividend[], uint32_t divisor[], uint32_t remainder[], uint32_t quotient[],
+                             int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        remainder[i] = 0;
+        quotient[i] = 0;
+    }
+
+    for (int bit = len * 32 - 1; bit >= 0; bit--)
+    {
+        uint32_t carry = (dividend[bit / 32] >> (bit % 32)) & 1;
+
+        for (int i = 0; i < len; i++)
+        {
+            uint32_t top = remainder[i] >> 31;
+
+            remainder[i] = (remainder[i] << 1) | carry;
+            carry = top;
+        }
+
+        if (carry || compare_limbs(remainder, divisor, len) >= 0)
+        {
+            uint64_t borrow = 0;
+
+            for (int i = 0; i < len; i++)
+            {
+                uint64_t t = (uint64_t)remainder[i] - divisor[i] - borrow;
+
+                remainder[i] = t;
+                borrow = (t >> 32) & 1;
+            }
+
+            quotient[bit / 32] |= 1u << (bit % 32);
+        }
+    }
+}
+
+static int udivmod(uint32_t dividend[], uint32_t divisor[], uint32_t remainder[], uint32_t quotient[], int len)
+{
+    switch (len)
+    {
+    case 4:
+        return udivmod128((__uint128_t *)dividend, (__uint128_t *)divisor, (__uint128_t *)remainder,
+                          (__uint128_t *)quotient);
+    case 8:
+        return udivmod256((uint256_t *)dividend, (uint256_t *)divisor, (uint256_t *)remainder, (uint256_t *)quotient);
+    default:
+        return udivmod512((uint512_t *)dividend, (uint512_t *)divisor, (uint512_t *)remainder, (uint512_t *)quotient);
+    }
+}
+
+static void test_divmod()
+{
+    // aligned for the wide integer types
+    uint32_t dividend[16] __attribute__((aligned(16))), divisor[16] __attribute__((aligned(16)));
+    uint32_t remainder[16] __attribute__((aligned(16))), quotient[16] __attribute__((aligned(16)));
+    uint32_t expected_remainder[16], expected_quotient[16], product[32];
+
+    for (int len = 4; len <= 16; len *= 2)
+    {
+        int width = len * 32;
+
+        for (int round = 0; round < 100000; round++)
+        {
+            random_limbs(divisor, len, rand() % width + 1);
+
+            if (rand() % 4)
+            {
+                random_limbs(dividend, len, rand() % (width + 1));
+            }
+            else
+            {
+                // A multiple of the divisor, less one: the estimated quotient digits are often too large
+                random_limbs(quotient, len, rand() % (width + 1));
+                reference_mul(divisor, quotient, product, len);
+
+                for (int i = 0; i < len; i++)
+                    dividend[i] = product[i];
+
+                for (int i = 0; i < len && !dividend[i]--; i++)
+                    ;
+            }
+
+            reference_divmod(dividend, divisor, expected_remainder, expected_quotient, len);
+
+            assert(!udivmod(dividend, divisor, remainder, quotient, len));
+            assert(!memcmp(remainder, expected_remainder, len * 4));
+            assert(!memcmp(quotient, expected_quotient, len * 4));
+
+            // The quotient may be written over the dividend, and the remainder over the divisor
+            memcpy(product, divisor, len * 4);
+
+            assert(!udivmod(dividend, divisor, divisor, dividend, len));
+            assert(!memcmp(divisor, expected_remainder, len * 4));
+            assert(!memcmp(dividend, expected_quotient, len * 4));
+
+            memcpy(dividend, expected_quotient, len * 4);
+            memcpy(divisor, product, len * 4);
+        }
+
+        memset(dividend, 0xff, len * 4);
+        memset(divisor, 0, len * 4);
+
+        assert(udivmod(dividend, divisor, remainder, quotient, len) == 1);
+    }
+
+    // 2^128 - 1 divided by 10^19, dividing in place like uint128dec() used to
+    __uint128_t q = ~(__uint128_t)0, d = 10000000000000000000ull, r;
+
+    assert(!udivmod128(&q, &d, &r, &q));
+    assert(q == ((__uint128_t)1 << 64) + 15581492618384294730ull);
+    assert(r == 3374607431768211455ull);
+}
+
+int main()
+{
+    srand(102);
+
+    test_mul();
+    test_divmod();
+
+    printf("bigint ok\n");
+
+    return 0;
+}
+#endif
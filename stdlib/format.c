@@ -1,27 +1,53 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include <stdint.h>
+#include "profile.h"
+
+// Two hex characters for each byte value
+static const char hex_pairs[512] __attribute__((aligned(2))) =
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+// A pair of characters from hex_pairs, and 8 characters, which may be stored at any alignment
+typedef uint16_t __attribute__((may_alias)) char_pair;
+typedef uint64_t __attribute__((may_alias, aligned(1))) unaligned_chars;
+
+static inline uint64_t hex_pair(uint8_t v)
+{
+    return ((const char_pair *)hex_pairs)[v];
+}
+
+static inline void store_pair(char *output, uint8_t v)
+{
+    output[0] = hex_pairs[v * 2];
+    output[1] = hex_pairs[v * 2 + 1];
+}
 
 void hex_encode(char *output, uint8_t *input, uint32_t length)
 {
-    for (int i = 0; i < length; i++)
-    {
-        uint8_t h = (input[i] >> 4);
-        *output++ = h > 9 ? h + 'a' - 10 : '0' + h;
-        uint8_t l = (input[i] & 0x0f);
-        *output++ = l > 9 ? l + 'a' - 10 : '0' + l;
-    }
+    // 4 bytes to 8 characters at a time
+    for (; length >= 4; length -= 4, input += 4, output += 8)
+        *(unaligned_chars *)output =
+            hex_pair(input[0]) | hex_pair(input[1]) << 16 | hex_pair(input[2]) << 32 | hex_pair(input[3]) << 48;
+
+    for (uint32_t i = 0; i < length; i++)
+        store_pair(output + i * 2, input[i]);
 }
 
 void hex_encode_rev(char *output, uint8_t *input, uint32_t length)
 {
-    for (int i = length - 1; i >= 0; i--)
-    {
-        uint8_t h = (input[i] >> 4);
-        *output++ = h > 9 ? h + 'a' - 10 : '0' + h;
-        uint8_t l = (input[i] & 0x0f);
-        *output++ = l > 9 ? l + 'a' - 10 : '0' + l;
-    }
+    for (; length >= 4; length -= 4, output += 8)
+        *(unaligned_chars *)output = hex_pair(input[length - 1]) | hex_pair(input[length - 2]) << 16 |
+                                     hex_pair(input[length - 3]) << 32 | hex_pair(input[length - 4]) << 48;
+
+    for (uint32_t i = 0; i < length; i++)
+        store_pair(output + i * 2, input[length - 1 - i]);
 }
 
 char *uint2hex(char *output, uint8_t *input, uint32_t length)
@@ -33,21 +59,25 @@ char *uint2hex(char *output, uint8_t *input, uint32_t length)
     *output++ = '0';
     *output++ = 'x';
 
-    uint8_t h = (input[length - 1] >> 4);
-    if (h > 0)
-        *output++ = h > 9 ? h + 'a' - 10 : '0' + h;
-    uint8_t l = (input[length - 1] & 0x0f);
-    *output++ = l > 9 ? l + 'a' - 10 : '0' + l;
+    uint8_t top = input[length - 1];
 
-    while (--length)
-    {
-        uint8_t h = (input[length - 1] >> 4);
-        *output++ = h > 9 ? h + 'a' - 10 : '0' + h;
-        uint8_t l = (input[length - 1] & 0x0f);
-        *output++ = l > 9 ? l + 'a' - 10 : '0' + l;
-    }
+    // no leading zero digit
+    if (top >= 0x10)
+        *output++ = hex_pairs[top * 2];
+    *output++ = hex_pairs[top * 2 + 1];
 
-    return output;
+    hex_encode_rev(output, input, length - 1);
+
+    return output + (length - 1) * 2;
+}
+
+// The 8 binary digits of v, most significant first, as characters in memory order. Each bit is
+// moved to its own byte with a multiply and a mask, and non-zero bytes become 1.
+static inline uint64_t bin_chars(uint8_t v)
+{
+    uint64_t bits = (v * 0x0101010101010101ULL) & 0x0102040810204080ULL;
+
+    return (((bits + 0x7f7f7f7f7f7f7f7fULL) >> 7) & 0x0101010101010101ULL) | 0x3030303030303030ULL;
 }
 
 char *uint2bin(char *output, uint8_t *input, uint32_t length)
@@ -61,152 +91,287 @@ char *uint2bin(char *output, uint8_t *input, uint32_t length)
 
     uint8_t v = input[length - 1];
 
-    int i = 8;
-
-    while (i > 0 && !(v & 0x80))
-    {
-        v <<= 1;
-        i--;
-    }
+    // no leading zeros
+    int i = v ? 32 - __builtin_clz(v) : 0;
+    uint64_t chars = i ? bin_chars(v) >> (8 * (8 - i)) : 0;
 
     while (i--)
     {
-        *output++ = v & 0x80 ? '1' : '0';
-        v <<= 1;
+        *output++ = chars;
+        chars >>= 8;
     }
 
     while (--length)
     {
-        uint8_t v = input[length - 1];
-        for (i = 0; i < 8; i++)
-        {
-            *output++ = v & 0x80 ? '1' : '0';
-            v <<= 1;
-        }
+        *(unaligned_chars *)output = bin_chars(input[length - 1]);
+        output += 8;
     }
 
     return output;
 }
 
+// The decimal digits of 0 to 99
+static const char digit_pairs[200] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Write val in decimal right to left, ending before end, with at least min_digits digits. Returns
+// the first digit. Two digits are generated at a time.
+static char *dec_backwards(char *end, uint64_t val, int min_digits)
+{
+    char *p = end;
+
+    while (val >= 100)
+    {
+        uint32_t pair = (val % 100) * 2;
+
+        val /= 100;
+        p -= 2;
+        p[0] = digit_pairs[pair];
+        p[1] = digit_pairs[pair + 1];
+    }
+
+    if (val >= 10)
+    {
+        p -= 2;
+        p[0] = digit_pairs[val * 2];
+        p[1] = digit_pairs[val * 2 + 1];
+    }
+    else
+    {
+        *--p = '0' + val;
+    }
+
+    while (end - p < min_digits)
+        *--p = '0';
+
+    return p;
+}
+
 char *uint2dec(char *output, uint64_t val)
 {
     char buf[20];
-    int len = 0;
+    char *end = buf + sizeof(buf);
 
-    // first generate the digits in left-to-right
-    do
+    for (char *p = dec_backwards(end, val, 0); p < end; p++)
+        *output++ = *p;
+
+    return output;
+}
+
+// 64 bit by 64 bit multiply with a 128 bit result. There is no native instruction for this on
+// bpf or wasm, and the __multi3 compiler runtime function is not available.
+static inline uint64_t mul64_high(uint64_t a, uint64_t b, uint64_t *low)
+{
+    uint64_t a0 = (uint32_t)a, a1 = a >> 32;
+    uint64_t b0 = (uint32_t)b, b1 = b >> 32;
+    uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    uint64_t mid = (p00 >> 32) + (uint32_t)p01 + (uint32_t)p10;
+
+    *low = (mid << 32) | (uint32_t)p00;
+
+    return p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+}
+
+// 10^19 is the largest power of 10 which fits in 64 bits, so the digits of a wide value are
+// generated in chunks of 19, each of which is formatted with 64 bit arithmetic.
+#define TEN19 10000000000000000000ULL
+// floor((2^128 - 1) / 10^19) - 2^64. 10^19 has its top bit set so needs no normalization.
+#define TEN19_RECIPROCAL 0xd83c94fb6d2ac34aULL
+
+// Divide high:low by 10^19 by multiplying with its reciprocal, see Moller and Granlund,
+// "Improved division by invariant integers". high must be less than 10^19.
+static inline uint64_t div_ten19(uint64_t high, uint64_t low, uint64_t *remainder)
+{
+    uint64_t q0;
+    uint64_t q1 = mul64_high(TEN19_RECIPROCAL, high, &q0);
+
+    q0 += low;
+    q1 += high + (q0 < low) + 1;
+
+    uint64_t r = low - q1 * TEN19;
+
+    if (r > q0)
     {
-        buf[len++] = val % 10;
-        val /= 10;
-    } while (val);
+        q1--;
+        r += TEN19;
+    }
 
-    // now copy them in to right-to-left
-    while (len--)
+    if (r >= TEN19)
     {
-        *output++ = buf[len] + '0';
+        q1++;
+        r -= TEN19;
     }
 
-    return output;
+    *remainder = r;
+
+    return q1;
 }
 
-extern int udivmod128(const __uint128_t *dividend, const __uint128_t *divisor, __uint128_t *remainder,
-                      __uint128_t *quotient);
+// Format the value in the little endian 64 bit limbs in decimal. The limbs are overwritten.
+static char *limbs2dec(char *output, uint64_t limbs[], int len, char *buf, int buf_len)
+{
+    char *end = buf + buf_len, *p = end;
+
+    while (len > 1 && !limbs[len - 1])
+        len--;
+
+    while (len > 1)
+    {
+        uint64_t r = 0;
+
+        PROFILE_LOOP(PROFILE_FORMAT_DEC);
+
+        for (int i = len - 1; i >= 0; i--)
+            limbs[i] = div_ten19(r, limbs[i], &r);
+
+        p = dec_backwards(p, r, 19);
+
+        if (!limbs[len - 1])
+            len--;
+    }
+
+    for (p = dec_backwards(p, limbs[0], 0); p < end; p++)
+        *output++ = *p;
+
+    return output;
+}
 
 char *uint128dec(char *output, __uint128_t val128)
 {
-    // we want 1e19, how to declare such a constant in clang?
-    const __uint128_t billion = 10000000000;
-    const __uint128_t divisor = billion * 1000000000;
-    __uint128_t q, r;
+    uint64_t limbs[2] = {val128, val128 >> 64};
     char buf[40];
-    int len = 0;
+    char *end = limbs2dec(output, limbs, 2, buf, sizeof(buf));
 
-    // first do the first 19 digits
+    PROFILE(PROFILE_FORMAT_DEC, end - output);
 
-    // divisor is never zero so we can ignore return value
-    udivmod128(&val128, &divisor, &r, &q);
+    return end;
+}
 
-    uint64_t val = r;
+typedef unsigned _BitInt(256) uint256_t;
 
-    do
-    {
-        buf[len++] = val % 10;
-        val /= 10;
-    } while (val);
+char *uint256dec(char *output, uint256_t *val256)
+{
+    uint256_t val = *val256;
+    uint64_t limbs[4] = {val, val >> 64, val >> 128, val >> 192};
+    char buf[80];
+    char *end = limbs2dec(output, limbs, 4, buf, sizeof(buf));
 
-    /// next 19 digits
-    udivmod128(&q, &divisor, &r, &q);
+    PROFILE(PROFILE_FORMAT_DEC, end - output);
 
-    val = r;
+    return end;
+}
 
-    if (val)
+static const char b58digits[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+// 58^5, the largest power of 58 which fits in 32 bits
+#define BASE58_5 656356768
+
+// Solana addresses are 32 bytes. The address is taken as a big endian number of eight 32 bit
+// limbs, which is divided by 58^5 at a time using 64 bit arithmetic. Each remainder gives five
+// digits. The output is right aligned and padded with '1', like the generic encoder below.
+static void base58_encode_32(uint8_t *data, uint8_t *output, uint32_t output_len)
+{
+    uint32_t limbs[8];
+    int start = 0;
+
+    for (int i = 0; i < 8; i++)
+        limbs[i] = ((uint32_t)data[4 * i] << 24) | ((uint32_t)data[4 * i + 1] << 16) |
+                   ((uint32_t)data[4 * i + 2] << 8) | data[4 * i + 3];
+
+    while (output_len > 0)
     {
-        // add 0s
-        while (len < 19)
+        while (start < 8 && !limbs[start])
+            start++;
+
+        uint64_t r = 0;
+
+        for (int i = start; i < 8; i++)
         {
-            buf[len++] = 0;
+            uint64_t cur = (r << 32) | limbs[i];
+            uint64_t q = cur / BASE58_5;
+
+            limbs[i] = q;
+            r = cur - q * BASE58_5;
         }
 
-        do
+        for (int k = 0; k < 5 && output_len > 0; k++)
         {
-            buf[len++] = val % 10;
-            val /= 10;
-        } while (val);
+            uint32_t digit = r % 58;
+
+            r /= 58;
+            output[--output_len] = b58digits[digit];
+        }
     }
+}
 
-    val = q;
+// https://github.com/bitcoin/libbase58/blob/b1dd03fa8d1be4be076bb6152325c6b5cf64f678/base58.c inspired this code.
+void base58_encode_solana_address(uint8_t *data, uint32_t data_len, uint8_t *output, uint32_t output_len)
+{
+    if (data_len == 32)
+    {
+        base58_encode_32(data, output, output_len);
+        return;
+    }
 
-    if (val)
+    uint32_t j, carry, zero_count = 0;
+
+    while (zero_count < data_len && !data[zero_count])
+        ++zero_count;
+
+    for (uint32_t i = zero_count, high = output_len - 1; i < data_len; i++, high = j)
     {
-        // add 0s
-        while (len < 38)
+        for (carry = data[i], j = output_len - 1; (j > high) || carry; --j)
         {
-            buf[len++] = 0;
+            carry += 256 * output[j];
+            output[j] = carry % 58;
+            carry /= 58;
+            if (!j)
+            {
+                break;
+            }
         }
-
-        do
-        {
-            buf[len++] = val % 10;
-            val /= 10;
-        } while (val);
     }
 
-    // now copy them in to right-to-left
-    while (len--)
+    for (j = 0; j < output_len; j++)
     {
-        *output++ = buf[len] + '0';
+        output[j] = b58digits[output[j]];
     }
-
-    return output;
 }
 
-typedef unsigned _BitInt(256) uint256_t;
+#ifdef TEST
+// Check the decimal formatting against a digit at a time conversion, and compare its speed with
+// the implementation it replaced, which divided by 10^19 with udivmod256(). The hex and binary
+// encoders are checked with known values.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
 
 extern int udivmod256(const uint256_t *dividend, const uint256_t *divisor, uint256_t *remainder, uint256_t *quotient);
 
-char *uint256dec(char *output, uint256_t *val256)
+static char *udivmod256_dec(char *output, uint256_t *val256)
 {
-    // we want 1e19, how to declare such a constant in clang?
     const uint256_t n1e10 = 10000000000;
     const uint256_t n1e9 = 1000000000;
     uint256_t divisor = n1e10 * n1e9;
-    uint256_t q = *val256, r;
+    uint256_t q = *val256, r, quotient;
     char buf[80];
     int len = 0;
 
-    // do the first digits
     for (int digits = 0; digits < 76; digits += 19)
     {
-        // divisor is never zero so we can ignore return value
-        udivmod256(&q, &divisor, &r, &q);
+        udivmod256(&q, &divisor, &r, &quotient);
+        q = quotient;
 
         uint64_t val = r;
 
-        // add 0s
         while (len < digits)
-        {
             buf[len++] = 0;
-        }
 
         do
         {
@@ -215,15 +380,17 @@ char *uint256dec(char *output, uint256_t *val256)
         } while (val);
 
         if (q == (uint256_t)0)
-        {
             break;
-        }
     }
 
     uint64_t val = q;
 
     if (val)
     {
+        // the old implementation did not pad the last group, so values over 10^76 were wrong
+        while (len < 76)
+            buf[len++] = 0;
+
         do
         {
             buf[len++] = val % 10;
@@ -231,41 +398,119 @@ char *uint256dec(char *output, uint256_t *val256)
         } while (val);
     }
 
-    // now copy them in to right-to-left
     while (len--)
-    {
         *output++ = buf[len] + '0';
-    }
 
     return output;
 }
 
-static const char b58digits[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+static char *reference_dec(char *output, uint256_t val)
+{
+    char buf[80];
+    int len = 0;
 
-// https://github.com/bitcoin/libbase58/blob/b1dd03fa8d1be4be076bb6152325c6b5cf64f678/base58.c inspired this code.
-void base58_encode_solana_address(uint8_t *data, uint32_t data_len, uint8_t *output, uint32_t output_len)
+    do
+    {
+        buf[len++] = '0' + (int)(val % 10);
+        val /= 10;
+    } while (val);
+
+    while (len--)
+        *output++ = buf[len];
+
+    return output;
+}
+
+static uint256_t random_value()
 {
-    uint32_t j, carry, zero_count = 0;
+    uint256_t val = 0;
 
-    while (zero_count < data_len && !data[zero_count])
-        ++zero_count;
+    for (int i = 0; i < 16; i++)
+        val = (val << 16) | (rand() & 0xffff);
 
-    for (uint32_t i = zero_count, high = output_len - 1; i < data_len; i++, high = j)
+    // vary the number of digits
+    return val >> (rand() % 256);
+}
+
+int main()
+{
+    char a[80], b[80];
+
+    srand(102);
+
+    for (int i = 0; i < 100000; i++)
     {
-        for (carry = data[i], j = output_len - 1; (j > high) || carry; --j)
-        {
-            carry += 256 * output[j];
-            output[j] = carry % 58;
-            carry /= 58;
-            if (!j)
-            {
-                break;
-            }
-        }
+        uint256_t val = random_value();
+
+        *uint256dec(a, &val) = 0;
+        *reference_dec(b, val) = 0;
+        assert(!strcmp(a, b));
+
+        // the speed is compared with this below, so check that it does the same work
+        *udivmod256_dec(a, &val) = 0;
+        assert(!strcmp(a, b));
+
+        __uint128_t val128 = val;
+
+        *uint128dec(a, val128) = 0;
+        *reference_dec(b, val128) = 0;
+        assert(!strcmp(a, b));
+
+        *uint2dec(a, val) = 0;
+        *reference_dec(b, (uint64_t)val) = 0;
+        assert(!strcmp(a, b));
     }
 
-    for (j = 0; j < output_len; j++)
+    uint256_t max = ~(uint256_t)0, zero = 0;
+
+    *uint256dec(a, &max) = 0;
+    assert(!strcmp(a, "115792089237316195423570985008687907853269984665640564039457584007913129639935"));
+    *uint256dec(a, &zero) = 0;
+    assert(!strcmp(a, "0"));
+
+    uint8_t bytes[5] = {0x0f, 0xa0, 0x01, 0x00, 0x00};
+
+    *uint2hex(a, bytes, 5) = 0;
+    assert(!strcmp(a, "0x1a00f"));
+    *uint2bin(a, bytes, 5) = 0;
+    assert(!strcmp(a, "0b11010000000001111"));
+    hex_encode(a, bytes, 5);
+    a[10] = 0;
+    assert(!strcmp(a, "0fa0010000"));
+    hex_encode_rev(a, bytes, 5);
+    a[10] = 0;
+    assert(!strcmp(a, "000001a00f"));
+
+    enum
     {
-        output[j] = b58digits[output[j]];
-    }
+        VALUES = 1024,
+        ROUNDS = 200
+    };
+    static uint256_t values[VALUES];
+
+    for (int i = 0; i < VALUES; i++)
+        values[i] = random_value();
+
+    clock_t start = clock();
+
+    for (int round = 0; round < ROUNDS; round++)
+        for (int i = 0; i < VALUES; i++)
+            udivmod256_dec(a, &values[i]);
+
+    clock_t middle = clock();
+
+    for (int round = 0; round < ROUNDS; round++)
+        for (int i = 0; i < VALUES; i++)
+            uint256dec(a, &values[i]);
+
+    clock_t end = clock();
+
+    printf("uint256dec: udivmod256 %.1f ns, reciprocal %.1f ns\n",
+           (double)(middle - start) * 1e9 / CLOCKS_PER_SEC / (VALUES * ROUNDS),
+           (double)(end - middle) * 1e9 / CLOCKS_PER_SEC / (VALUES * ROUNDS));
+
+    printf("format ok\n");
+
+    return 0;
 }
+#endif
@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include "stdlib.h"
+#include "profile.h"
 
 #ifndef __wasm__
 #include "solana_sdk.h"
@@ -15,8 +16,16 @@
    - not many malloc objects
    - not much memory
 
-  So I think we should avoid fragmentation by neighbour merging. The most
-  costly is walking the doubly linked list looking for free space.
+  So I think we should avoid fragmentation by neighbour merging. Walking the
+  doubly linked list looking for free space is costly, so free chunks are also
+  kept on size class free lists ("bins"). The heads of the bins live in the
+  payload of the first chunk, which is always allocated; Solana does not allow
+  writable globals so they cannot live anywhere else.
+
+  Chunk lengths are always a multiple of 8. Small lengths have a bin each, so
+  any chunk from a non-empty bin which is at least as large as the request will
+  do. Larger lengths are binned by power of two. A bitmap records which bins
+  are non-empty, so finding a bin is a count trailing zeros.
 */
 struct chunk
 {
@@ -25,93 +34,285 @@ struct chunk
     uint32_t allocated;
 };
 
+// Free chunks keep their free list links in their payload
+struct free_links
+{
+    struct chunk *next_free, *prev_free;
+};
+
+// Smallest payload of a chunk, so that a free chunk can hold its free list links
+#define MIN_LENGTH 16
+
+// Lengths 16 to 120 get an exact bin each
+#define EXACT_BINS 14
+#define EXACT_LIMIT 128
+// Lengths from 2^7 to 2^32 get a bin per power of two
+#define BINS (EXACT_BINS + 25)
+
+struct bins
+{
+    uint64_t bitmap;
+    struct chunk *head[BINS];
+    // Highest offset from the start of the heap which has been handed out, for __heap_stats()
+    uint32_t high_water;
+};
+
 #ifdef __wasm__
+// The contract starts with as little memory as possible. When the heap runs out, memory is grown
 #define HEAP_START ((struct chunk *)0x10000)
+#define HEAP_LENGTH (uint32_t)(__builtin_wasm_memory_size(0) * WASM_PAGE_SIZE - (size_t)HEAP_START)
+#define WASM_PAGE_SIZE 0x10000
+#else
+#define HEAP_START ((struct chunk *)0x300000000)
+// Set by the compiler. The transaction must request a heap frame of at least this size
+// if it is larger than the default of 32KiB.
+extern const uint32_t __heap_size;
+// The profiling build keeps its counters at the end of the heap frame
+#define HEAP_LENGTH (__heap_size - PROFILE_RESERVED)
+#endif
 
-void __init_heap()
+#define BINS_CHUNK HEAP_START
+#define HEAP_BINS ((struct bins *)(BINS_CHUNK + 1))
+
+static inline struct free_links *links(struct chunk *cur)
 {
-    struct chunk *first = HEAP_START;
-    first->next = first->prev = NULL;
-    first->allocated = false;
-    first->length = (uint32_t)(__builtin_wasm_memory_size(0) * 0x10000 - (size_t)first - sizeof(struct chunk));
+    return (struct free_links *)(cur + 1);
+}
+
+static inline uint32_t bin_index(uint32_t length)
+{
+    if (length < EXACT_LIMIT)
+        return (length >> 3) - 2;
+
+    // 2^7 goes in EXACT_BINS
+    return EXACT_BINS + (31 - __builtin_clz(length)) - 7;
+}
+
+static void bin_insert(struct chunk *cur)
+{
+    struct bins *bins = HEAP_BINS;
+    uint32_t index = bin_index(cur->length);
+    struct chunk *head = bins->head[index];
+
+    links(cur)->next_free = head;
+    links(cur)->prev_free = NULL;
+    if (head)
+        links(head)->prev_free = cur;
+
+    bins->head[index] = cur;
+    bins->bitmap |= 1ULL << index;
+}
+
+static void bin_remove(struct chunk *cur)
+{
+    struct bins *bins = HEAP_BINS;
+    struct chunk *next_free = links(cur)->next_free;
+    struct chunk *prev_free = links(cur)->prev_free;
+
+    if (next_free)
+        links(next_free)->prev_free = prev_free;
+
+    if (prev_free)
+    {
+        links(prev_free)->next_free = next_free;
+    }
+    else
+    {
+        uint32_t index = bin_index(cur->length);
+
+        bins->head[index] = next_free;
+        if (!next_free)
+            bins->bitmap &= ~(1ULL << index);
+    }
 }
-#else
-#define HEAP_START ((struct chunk *)0x300000000)
 
 void __init_heap()
 {
-    struct chunk *first = HEAP_START;
-    first->next = first->prev = NULL;
-    first->allocated = false;
-    first->length = (32 * 1024) - sizeof(struct chunk);
+    struct chunk *first = BINS_CHUNK;
+    struct chunk *free = (void *)HEAP_BINS + sizeof(struct bins);
+    struct bins *bins = HEAP_BINS;
+
+    first->next = free;
+    first->prev = NULL;
+    first->allocated = true;
+    first->length = sizeof(struct bins);
+
+    free->next = NULL;
+    free->prev = first;
+    free->allocated = false;
+    free->length = HEAP_LENGTH - sizeof(struct bins) - 2 * sizeof(struct chunk);
+
+    bins->bitmap = 0;
+    for (int i = 0; i < BINS; i++)
+        bins->head[i] = NULL;
+
+    bins->high_water = (void *)free - (void *)HEAP_START;
+
+    bin_insert(free);
+}
+
+// Mark a chunk as free, merge it with its free neighbours and put it in its bin
+static void release_chunk(struct chunk *cur)
+{
+    cur->allocated = false;
+
+    struct chunk *next = cur->next;
+    if (next && !next->allocated)
+    {
+        // merge with next
+        bin_remove(next);
+        if ((cur->next = next->next) != NULL)
+            cur->next->prev = cur;
+        cur->length += next->length + sizeof(struct chunk);
+    }
+
+    struct chunk *prev = cur->prev;
+    if (prev && !prev->allocated)
+    {
+        // merge with previous
+        bin_remove(prev);
+        if ((prev->next = cur->next) != NULL)
+            prev->next->prev = prev;
+        prev->length += cur->length + sizeof(struct chunk);
+        cur = prev;
+    }
+
+    bin_insert(cur);
 }
-#endif
 
 void __attribute__((noinline)) __free(void *m)
 {
-    struct chunk *cur = m;
-    cur--;
     if (m)
     {
-        cur->allocated = false;
-        struct chunk *next = cur->next;
-        if (next && !next->allocated)
-        {
-            // merge with next
-            if ((cur->next = next->next) != NULL)
-                cur->next->prev = cur;
-            cur->length += next->length + sizeof(struct chunk);
-            next = cur->next;
-        }
-
-        struct chunk *prev = cur->prev;
-        if (prev && !prev->allocated)
-        {
-            // merge with previous
-            prev->next = next;
-            next->prev = prev;
-            prev->length += cur->length + sizeof(struct chunk);
-        }
+        struct chunk *cur = m;
+        release_chunk(cur - 1);
     }
 }
 
+// size must be rounded up already
 static void shrink_chunk(struct chunk *cur, uint32_t size)
 {
-    // round up to nearest 8 bytes
-    size = (size + 7) & ~7;
-
-    if (cur->length - size >= (8 + sizeof(struct chunk)))
+    if (cur->length - size >= (MIN_LENGTH + sizeof(struct chunk)))
     {
-        // split and return
+        // split and release the remainder
         void *data = (cur + 1);
         struct chunk *new = data + size;
         if ((new->next = cur->next) != NULL)
             new->next->prev = new;
         cur->next = new;
         new->prev = cur;
-        new->allocated = false;
         new->length = cur->length - size - sizeof(struct chunk);
         cur->length = size;
+        release_chunk(new);
+    }
+}
+
+// The allocated chunk may be the highest chunk which has been handed out so far
+static inline void update_high_water(struct chunk *cur)
+{
+    uint32_t end = (void *)(cur + 1) + cur->length - (void *)HEAP_START;
+
+    if (end > HEAP_BINS->high_water)
+        HEAP_BINS->high_water = end;
+}
+
+#ifdef __wasm__
+// Grow the memory so that the heap has a free chunk of at least size at the end
+static bool grow_heap(uint32_t size)
+{
+    struct chunk *last = BINS_CHUNK;
+
+    while (last->next)
+    {
+        PROFILE_LOOP(PROFILE_MALLOC);
+        last = last->next;
+    }
+
+    // if the last chunk is free, it is smaller than size, else __malloc would have used it
+    uint32_t needed = last->allocated ? size + sizeof(struct chunk) : size - last->length;
+    uint32_t pages = (needed + WASM_PAGE_SIZE - 1) / WASM_PAGE_SIZE;
+    size_t old_pages = __builtin_wasm_memory_grow(0, pages);
+
+    if (old_pages == (size_t)-1)
+        return false;
+
+    uint32_t grown = pages * WASM_PAGE_SIZE;
+
+    if (last->allocated)
+    {
+        struct chunk *new = (struct chunk *)(old_pages * WASM_PAGE_SIZE);
+
+        new->next = NULL;
+        new->prev = last;
+        new->allocated = false;
+        new->length = grown - sizeof(struct chunk);
+        last->next = new;
+
+        bin_insert(new);
+    }
+    else
+    {
+        bin_remove(last);
+        last->length += grown;
+        bin_insert(last);
     }
+
+    return true;
+}
+#endif
+
+static inline uint32_t round_size(uint32_t size)
+{
+    // round up to nearest 8 bytes
+    size = (size + 7) & ~7;
+
+    return size < MIN_LENGTH ? MIN_LENGTH : size;
 }
 
 void *__attribute__((noinline)) __malloc(uint32_t size)
 {
-    struct chunk *cur = HEAP_START;
+    struct bins *bins = HEAP_BINS;
+    struct chunk *cur = NULL;
+
+    PROFILE(PROFILE_MALLOC, size);
+
+    size = round_size(size);
+
+    uint32_t index = bin_index(size);
 
-    while (cur && (cur->allocated || size > cur->length))
-        cur = cur->next;
+    // Chunks in a power of two bin may be smaller than size, unless size is the
+    // bottom of the bin. Do first fit in this bin before moving on to the next.
+    if (size >= EXACT_LIMIT && (size & (size - 1)) != 0)
+    {
+        for (cur = bins->head[index]; cur && cur->length < size; cur = links(cur)->next_free)
+            PROFILE_LOOP(PROFILE_MALLOC);
+
+        index++;
+    }
+
+    if (!cur)
+    {
+        uint64_t candidates = index < BINS ? bins->bitmap >> index : 0;
+
+        if (candidates)
+            cur = bins->head[index + __builtin_ctzll(candidates)];
+    }
 
     if (cur)
     {
-        shrink_chunk(cur, size);
+        bin_remove(cur);
         cur->allocated = true;
+        shrink_chunk(cur, size);
+        update_high_water(cur);
         return ++cur;
     }
     else
     {
         // go bang
 #ifdef __wasm__
+        if (grow_heap(size))
+            return __malloc(size);
+
         __builtin_unreachable();
 #else
         sol_log("out of heap memory");
@@ -127,28 +328,38 @@ void *__realloc(void *m, uint32_t size)
 
     cur--;
 
+    PROFILE(PROFILE_REALLOC, size);
+
+    size = round_size(size);
+
+    if (size <= cur->length)
+    {
+        // shrink in place
+        shrink_chunk(cur, size);
+        return m;
+    }
+
     struct chunk *next = cur->next;
 
     if (next && !next->allocated && size <= (cur->length + next->length + sizeof(struct chunk)))
     {
         // merge with next
+        bin_remove(next);
         cur->next = next->next;
         if (cur->next)
             cur->next->prev = cur;
         cur->length += next->length + sizeof(struct chunk);
         // resplit ..
         shrink_chunk(cur, size);
+        update_high_water(cur);
         return m;
     }
     else
     {
-        // allocate new area and copy old data
+        // allocate new area and copy old data; the new size is larger so all
+        // the old data fits
         uint32_t len = cur->length;
 
-        // if new size is smaller than the old data, only copy remaining data
-        if (size < len)
-            len = size;
-
         void *n = __malloc(size);
 
         // __memcpy8() copies 8 bytes at once; round up to the nearest 8 bytes
@@ -159,3 +370,189 @@ void *__realloc(void *m, uint32_t size)
         return n;
     }
 }
+
+void __heap_stats(struct heap_stats *stats)
+{
+    stats->high_water = HEAP_BINS->high_water;
+    stats->live_allocations = 0;
+    stats->live_bytes = 0;
+    stats->free_chunks = 0;
+    stats->largest_free = 0;
+
+    // the first chunk holds the bins, which is not an allocation
+    for (struct chunk *cur = BINS_CHUNK->next; cur; cur = cur->next)
+    {
+        if (cur->allocated)
+        {
+            stats->live_allocations++;
+            stats->live_bytes += cur->length;
+        }
+        else
+        {
+            stats->free_chunks++;
+            if (cur->length > stats->largest_free)
+                stats->largest_free = cur->length;
+        }
+    }
+}
+
+#ifdef TEST
+// Exercise the allocator on the host, against a buffer at the address of the heap
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+const uint32_t __heap_size = 64 * 1024;
+
+void sol_panic_(const char *file, uint64_t len, uint64_t line, uint64_t column)
+{
+    printf("panic: %s:%lu\n", file, (unsigned long)line);
+    abort();
+}
+
+void __memcpy8(void *_dest, void *_src, uint32_t length)
+{
+    uint64_t *dest = _dest;
+    uint64_t *src = _src;
+
+    while (length--)
+        *dest++ = *src++;
+}
+
+// Check the chunk list and the bins agree
+static void heap_check()
+{
+    struct bins *bins = HEAP_BINS;
+    uint32_t total = 0, free_chunks = 0, binned = 0, live_bytes = 0, largest_free = 0;
+    struct chunk *prev = NULL;
+
+    for (struct chunk *cur = BINS_CHUNK; cur; cur = cur->next)
+    {
+        assert(cur->prev == prev);
+        assert((cur->length & 7) == 0);
+        assert(cur->length >= MIN_LENGTH || cur == BINS_CHUNK);
+        if (cur->next)
+            assert((void *)cur->next == (void *)(cur + 1) + cur->length);
+        if (!cur->allocated)
+        {
+            assert(!prev || prev->allocated);
+            free_chunks++;
+            if (cur->length > largest_free)
+                largest_free = cur->length;
+        }
+        else if (cur != BINS_CHUNK)
+        {
+            assert((void *)(cur + 1) + cur->length - (void *)HEAP_START <= bins->high_water);
+            live_bytes += cur->length;
+        }
+        total += cur->length + sizeof(struct chunk);
+        prev = cur;
+    }
+
+    assert(total == HEAP_LENGTH);
+
+    for (int i = 0; i < BINS; i++)
+    {
+        assert(!!bins->head[i] == !!(bins->bitmap & (1ULL << i)));
+
+        struct chunk *prev_free = NULL;
+
+        for (struct chunk *cur = bins->head[i]; cur; cur = links(cur)->next_free)
+        {
+            assert(!cur->allocated);
+            assert(bin_index(cur->length) == i);
+            assert(links(cur)->prev_free == prev_free);
+            prev_free = cur;
+            binned++;
+        }
+    }
+
+    assert(free_chunks == binned);
+
+    struct heap_stats stats;
+
+    __heap_stats(&stats);
+
+    assert(stats.free_chunks == free_chunks && stats.largest_free == largest_free && stats.live_bytes == live_bytes);
+    assert(stats.high_water <= HEAP_LENGTH);
+}
+
+int main()
+{
+    void *heap = mmap(HEAP_START, HEAP_LENGTH, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+    assert(heap == HEAP_START);
+
+    __init_heap();
+    heap_check();
+
+    void *ptrs[64] = {0};
+    uint32_t sizes[64] = {0};
+
+    srand(102);
+
+    for (int round = 0; round < 100000; round++)
+    {
+        int i = rand() % 64;
+
+        if (ptrs[i] && rand() % 4 == 0)
+        {
+            uint32_t size = rand() % 600;
+            uint8_t *p = __realloc(ptrs[i], size);
+            uint32_t keep = size < sizes[i] ? size : sizes[i];
+
+            for (uint32_t j = 0; j < keep; j++)
+                assert(p[j] == (uint8_t)(i + j));
+            for (uint32_t j = keep; j < size; j++)
+                p[j] = i + j;
+
+            ptrs[i] = p;
+            sizes[i] = size;
+        }
+        else if (ptrs[i])
+        {
+            uint8_t *p = ptrs[i];
+
+            for (uint32_t j = 0; j < sizes[i]; j++)
+                assert(p[j] == (uint8_t)(i + j));
+
+            __free(p);
+            ptrs[i] = NULL;
+        }
+        else
+        {
+            uint32_t size = rand() % 8 ? rand() % 128 : rand() % 600;
+            uint8_t *p = __malloc(size);
+
+            assert(((uintptr_t)p & 7) == 0);
+            for (uint32_t j = 0; j < size; j++)
+                p[j] = i + j;
+
+            ptrs[i] = p;
+            sizes[i] = size;
+        }
+
+        heap_check();
+    }
+
+    for (int i = 0; i < 64; i++)
+        __free(ptrs[i]);
+
+    heap_check();
+
+    // everything should be merged back into one free chunk
+    assert(BINS_CHUNK->next->next == NULL);
+
+    struct heap_stats stats;
+
+    __heap_stats(&stats);
+
+    assert(stats.live_allocations == 0 && stats.free_chunks == 1);
+    printf("high water mark %u bytes\n", stats.high_water);
+
+    printf("heap ok\n");
+
+    return 0;
+}
+#endif
@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: Apache-2.0
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "stdlib.h"
+#include "profile.h"
+#include "solana_sdk.h"
+
+/*
+  Arena heap for Solana. A program invocation is short-lived and its heap is
+  thrown away at the end, so there is no need to reuse freed memory. Memory
+  is handed out from the top of the arena, and __free does nothing. This is
+  smaller and cheaper than heap.c, but contracts which allocate a lot in a
+  loop may run out of heap.
+
+  Each allocation is preceded by its length, so __realloc knows how much to
+  copy. The last allocation can be resized in place.
+*/
+struct arena
+{
+    uint8_t *top;
+    uint8_t *last;
+    // The top is lowered when the last allocation shrinks, so this is kept for __heap_stats()
+    uint8_t *high_water;
+};
+
+struct block
+{
+    uint64_t length;
+};
+
+#define HEAP_START ((struct arena *)0x300000000)
+// Set by the compiler
+extern const uint32_t __heap_size;
+// The profiling build keeps its counters at the end of the heap frame
+#define HEAP_LENGTH (__heap_size - PROFILE_RESERVED)
+#define HEAP_END ((uint8_t *)HEAP_START + HEAP_LENGTH)
+
+void __init_heap()
+{
+    struct arena *arena = HEAP_START;
+
+    arena->top = (uint8_t *)(arena + 1);
+    arena->last = NULL;
+    arena->high_water = arena->top;
+}
+
+void __attribute__((noinline)) __free(void *m)
+{
+}
+
+static inline uint32_t round_size(uint32_t size)
+{
+    // round up to nearest 8 bytes
+    return (size + 7) & ~7;
+}
+
+static inline void update_high_water(struct arena *arena)
+{
+    if (arena->top > arena->high_water)
+        arena->high_water = arena->top;
+}
+
+static void out_of_memory()
+{
+    sol_log("out of heap memory");
+    sol_panic();
+}
+
+void *__attribute__((noinline)) __malloc(uint32_t size)
+{
+    struct arena *arena = HEAP_START;
+    struct block *block = (struct block *)arena->top;
+    uint8_t *data = (uint8_t *)(block + 1);
+
+    PROFILE(PROFILE_MALLOC, size);
+
+    size = round_size(size);
+
+    if (size + sizeof(struct block) > (uint64_t)(HEAP_END - arena->top))
+        out_of_memory();
+
+    block->length = size;
+    arena->last = data;
+    arena->top = data + size;
+    update_high_water(arena);
+
+    return data;
+}
+
+void *__realloc(void *m, uint32_t size)
+{
+    struct arena *arena = HEAP_START;
+    struct block *block = (struct block *)m - 1;
+
+    PROFILE(PROFILE_REALLOC, size);
+
+    size = round_size(size);
+
+    if (m == arena->last)
+    {
+        // extend or shrink in place
+        if (size > (uint64_t)(HEAP_END - (uint8_t *)m))
+            out_of_memory();
+
+        block->length = size;
+        arena->top = (uint8_t *)m + size;
+        update_high_water(arena);
+
+        return m;
+    }
+
+    if (size <= block->length)
+        return m;
+
+    void *n = __malloc(size);
+
+    // __memcpy8() copies 8 bytes at once; allocations are always a multiple of 8 bytes
+    __memcpy8(n, m, block->length / 8);
+
+    return n;
+}
+
+// Nothing is ever freed, so every allocation is live, even if it has been reallocated elsewhere
+void __heap_stats(struct heap_stats *stats)
+{
+    struct arena *arena = HEAP_START;
+
+    stats->high_water = arena->high_water - (uint8_t *)HEAP_START;
+    stats->live_allocations = 0;
+    stats->live_bytes = 0;
+
+    for (uint8_t *p = (uint8_t *)(arena + 1); p < arena->top; p += sizeof(struct block) + ((struct block *)p)->length)
+    {
+        stats->live_allocations++;
+        stats->live_bytes += ((struct block *)p)->length;
+    }
+
+    stats->free_chunks = 1;
+    stats->largest_free = HEAP_END - arena->top;
+}
+
+#ifdef TEST
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+const uint32_t __heap_size = 32 * 1024;
+
+void sol_panic_(const char *file, uint64_t len, uint64_t line, uint64_t column)
+{
+    printf("panic: %s:%lu\n", file, (unsigned long)line);
+    abort();
+}
+
+void __memcpy8(void *_dest, void *_src, uint32_t length)
+{
+    uint64_t *dest = _dest;
+    uint64_t *src = _src;
+
+    while (length--)
+        *dest++ = *src++;
+}
+
+int main()
+{
+    void *heap = mmap(HEAP_START, HEAP_LENGTH, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+                      -1, 0);
+
+    assert(heap == HEAP_START);
+
+    __init_heap();
+
+    uint8_t *a = __malloc(5);
+    uint8_t *b = __malloc(0);
+    uint8_t *c = __malloc(20);
+
+    assert(((uintptr_t)a & 7) == 0 && ((uintptr_t)b & 7) == 0 && ((uintptr_t)c & 7) == 0);
+    assert(b == a + 8 + 8 && c == b + 8);
+
+    for (int i = 0; i < 20; i++)
+        c[i] = i;
+
+    // the last allocation grows in place
+    assert(__realloc(c, 100) == c);
+    assert(HEAP_START->top == c + 104);
+
+    // other allocations are copied
+    for (int i = 0; i < 5; i++)
+        a[i] = i + 100;
+
+    uint8_t *d = __realloc(a, 64);
+
+    assert(d == c + 104 + 8);
+    for (int i = 0; i < 5; i++)
+        assert(d[i] == i + 100);
+
+    // shrinking the last allocation releases the space
+    assert(__realloc(d, 8) == d);
+    assert(HEAP_START->top == d + 8);
+
+    struct heap_stats stats;
+
+    __heap_stats(&stats);
+
+    assert(stats.live_allocations == 4 && stats.live_bytes == 8 + 0 + 104 + 8);
+    assert(stats.high_water == (uint8_t *)d + 64 - (uint8_t *)HEAP_START);
+    assert(stats.largest_free == HEAP_END - HEAP_START->top);
+
+    // fill the heap exactly
+    uint8_t *e = __malloc(HEAP_END - HEAP_START->top - sizeof(struct block));
+
+    assert(HEAP_START->top == HEAP_END);
+    assert(__realloc(e, 8) == e);
+    assert(__malloc(HEAP_END - HEAP_START->top - sizeof(struct block)) == e + 16);
+
+    printf("heap arena ok\n");
+
+    return 0;
+}
+#endif
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+ * Counters for the profiling build of the stdlib, which is built with -DSTDLIB_PROFILE.
+ * Each hot helper counts how often it is called, an amount, and the iterations of its main
+ * loop. The amount is bytes for the memory helpers, significant 32 bit limbs of the dividend
+ * for division and digits for formatting. On Solana, the entrypoint logs the counters with
+ * sol_log_64 before it returns. On Wasm, codegen calls __profile_log() before the contract
+ * returns, which writes them to the debug buffer.
+ *
+ * Solana does not allow writable globals, so there the counters live at the end of the heap
+ * frame, and the heaps leave that space alone. Wasm has writable globals, so there they are a
+ * global in stdlib.c. In the normal build this is all empty.
+ */
+enum profile_helper
+{
+    PROFILE_MALLOC,
+    PROFILE_REALLOC,
+    PROFILE_MEMCPY,
+    PROFILE_MEMSET,
+    PROFILE_DIVMOD,
+    PROFILE_FORMAT_DEC,
+    PROFILE_ACCOUNT_ALLOC,
+    PROFILE_ACCOUNT_REALLOC,
+    PROFILE_ACCOUNT_FREE,
+    PROFILE_HELPERS,
+};
+
+struct profile_counter
+{
+    uint64_t calls;
+    uint64_t amount;
+    uint64_t iterations;
+};
+
+#if defined(STDLIB_PROFILE) && defined(__wasm__)
+extern struct profile_counter __profile_counters[PROFILE_HELPERS];
+
+#define PROFILE_RESERVED 0
+#define PROFILE_COUNTERS __profile_counters
+#elif defined(STDLIB_PROFILE)
+extern const uint32_t __heap_size;
+
+#define PROFILE_RESERVED (PROFILE_HELPERS * sizeof(struct profile_counter))
+#define PROFILE_COUNTERS ((struct profile_counter *)(0x300000000 + __heap_size - PROFILE_RESERVED))
+#else
+#define PROFILE_RESERVED 0
+#endif
+
+#ifdef STDLIB_PROFILE
+#define PROFILE(helper, n)                                                                                             \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        PROFILE_COUNTERS[helper].calls++;                                                                              \
+        PROFILE_COUNTERS[helper].amount += (n);                                                                        \
+    } while (0)
+#define PROFILE_LOOP(helper)                                                                                           \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        PROFILE_COUNTERS[helper].iterations++;                                                                         \
+    } while (0)
+#else
+#define PROFILE(helper, n)                                                                                             \
+    do                                                                                                                 \
+    {                                                                                                                  \
+    } while (0)
+#define PROFILE_LOOP(helper)                                                                                           \
+    do                                                                                                                 \
+    {                                                                                                                  \
+    } while (0)
+#endif
@@ -49,11 +49,14 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include "stdlib.h"
 
 #define RIPEMD160_DIGEST_SIZE 20
 #define BLOCK_SIZE 64
 
+/* The state for the incremental interface: ripemd160_init(), ripemd160_update() and
+ * ripemd160_final(). It is 104 bytes with 8 byte alignment on both wasm32 and bpf. */
 typedef struct
 {
     uint32_t h[5];   /* The current hash state */
@@ -67,6 +70,9 @@ typedef struct
     uint8_t bufpos; /* number of bytes currently in the buffer */
 } ripemd160_state;
 
+/* Message words may be loaded straight from the caller's memory */
+typedef uint32_t __attribute__((may_alias)) message_word;
+
 /* cyclic left-shift the 32-bit word n left by s bits */
 #define ROL(s, n) (((n) << (s)) | ((n) >> (32 - (s))))
 
@@ -154,8 +160,10 @@ static const uint32_t KR[5] = {
     0x00000000u  /* Round 5: 0 */
 };
 
-/* The RIPEMD160 compression function.  Operates on self->buf */
-static void ripemd160_compress(ripemd160_state *self)
+/* The RIPEMD160 compression function. Operates on one block of 16 little-endian words, which is
+ * either self->buf or 4 byte aligned input. The state is not secret in a smart contract, so the
+ * block and the temporary variables are not wiped afterwards. */
+static void ripemd160_compress(ripemd160_state *self, const message_word *x)
 {
     uint8_t w, round;
     uint32_t T;
@@ -173,7 +181,7 @@ static void ripemd160_compress(ripemd160_state *self)
     round = 0;
     for (w = 0; w < 16; w++)
     { /* left line */
-        T = ROL(SL[round][w], AL + F1(BL, CL, DL) + self->buf.w[RL[round][w]] + KL[round]) + EL;
+        T = ROL(SL[round][w], AL + F1(BL, CL, DL) + x[RL[round][w]] + KL[round]) + EL;
         AL = EL;
         EL = DL;
         DL = ROL(10, CL);
@@ -182,7 +190,7 @@ static void ripemd160_compress(ripemd160_state *self)
     }
     for (w = 0; w < 16; w++)
     { /* right line */
-        T = ROL(SR[round][w], AR + F5(BR, CR, DR) + self->buf.w[RR[round][w]] + KR[round]) + ER;
+        T = ROL(SR[round][w], AR + F5(BR, CR, DR) + x[RR[round][w]] + KR[round]) + ER;
         AR = ER;
         ER = DR;
         DR = ROL(10, CR);
@@ -194,7 +202,7 @@ static void ripemd160_compress(ripemd160_state *self)
     round++;
     for (w = 0; w < 16; w++)
     { /* left line */
-        T = ROL(SL[round][w], AL + F2(BL, CL, DL) + self->buf.w[RL[round][w]] + KL[round]) + EL;
+        T = ROL(SL[round][w], AL + F2(BL, CL, DL) + x[RL[round][w]] + KL[round]) + EL;
         AL = EL;
         EL = DL;
         DL = ROL(10, CL);
@@ -203,7 +211,7 @@ static void ripemd160_compress(ripemd160_state *self)
     }
     for (w = 0; w < 16; w++)
     { /* right line */
-        T = ROL(SR[round][w], AR + F4(BR, CR, DR) + self->buf.w[RR[round][w]] + KR[round]) + ER;
+        T = ROL(SR[round][w], AR + F4(BR, CR, DR) + x[RR[round][w]] + KR[round]) + ER;
         AR = ER;
         ER = DR;
         DR = ROL(10, CR);
@@ -215,7 +223,7 @@ static void ripemd160_compress(ripemd160_state *self)
     round++;
     for (w = 0; w < 16; w++)
     { /* left line */
-        T = ROL(SL[round][w], AL + F3(BL, CL, DL) + self->buf.w[RL[round][w]] + KL[round]) + EL;
+        T = ROL(SL[round][w], AL + F3(BL, CL, DL) + x[RL[round][w]] + KL[round]) + EL;
         AL = EL;
         EL = DL;
         DL = ROL(10, CL);
@@ -224,7 +232,7 @@ static void ripemd160_compress(ripemd160_state *self)
     }
     for (w = 0; w < 16; w++)
     { /* right line */
-        T = ROL(SR[round][w], AR + F3(BR, CR, DR) + self->buf.w[RR[round][w]] + KR[round]) + ER;
+        T = ROL(SR[round][w], AR + F3(BR, CR, DR) + x[RR[round][w]] + KR[round]) + ER;
         AR = ER;
         ER = DR;
         DR = ROL(10, CR);
@@ -236,7 +244,7 @@ static void ripemd160_compress(ripemd160_state *self)
     round++;
     for (w = 0; w < 16; w++)
     { /* left line */
-        T = ROL(SL[round][w], AL + F4(BL, CL, DL) + self->buf.w[RL[round][w]] + KL[round]) + EL;
+        T = ROL(SL[round][w], AL + F4(BL, CL, DL) + x[RL[round][w]] + KL[round]) + EL;
         AL = EL;
         EL = DL;
         DL = ROL(10, CL);
@@ -245,7 +253,7 @@ static void ripemd160_compress(ripemd160_state *self)
     }
     for (w = 0; w < 16; w++)
     { /* right line */
-        T = ROL(SR[round][w], AR + F2(BR, CR, DR) + self->buf.w[RR[round][w]] + KR[round]) + ER;
+        T = ROL(SR[round][w], AR + F2(BR, CR, DR) + x[RR[round][w]] + KR[round]) + ER;
         AR = ER;
         ER = DR;
         DR = ROL(10, CR);
@@ -257,7 +265,7 @@ static void ripemd160_compress(ripemd160_state *self)
     round++;
     for (w = 0; w < 16; w++)
     { /* left line */
-        T = ROL(SL[round][w], AL + F5(BL, CL, DL) + self->buf.w[RL[round][w]] + KL[round]) + EL;
+        T = ROL(SL[round][w], AL + F5(BL, CL, DL) + x[RL[round][w]] + KL[round]) + EL;
         AL = EL;
         EL = DL;
         DL = ROL(10, CL);
@@ -266,7 +274,7 @@ static void ripemd160_compress(ripemd160_state *self)
     }
     for (w = 0; w < 16; w++)
     { /* right line */
-        T = ROL(SR[round][w], AR + F1(BR, CR, DR) + self->buf.w[RR[round][w]] + KR[round]) + ER;
+        T = ROL(SR[round][w], AR + F1(BR, CR, DR) + x[RR[round][w]] + KR[round]) + ER;
         AR = ER;
         ER = DR;
         DR = ROL(10, CR);
@@ -281,60 +289,79 @@ static void ripemd160_compress(ripemd160_state *self)
     self->h[3] = self->h[4] + AL + BR;
     self->h[4] = self->h[0] + BL + CR;
     self->h[0] = T;
+}
 
-    /* Clear the buffer and wipe the temporary variables */
-    T = AL = BL = CL = DL = EL = AR = BR = CR = DR = ER = 0;
-    __memset(&self->buf, 0, sizeof(self->buf));
+void ripemd160_init(ripemd160_state *self)
+{
+    __memcpy(&self->h, initial_h, sizeof(initial_h));
+    self->length = 0;
     self->bufpos = 0;
 }
 
-static void ripemd160_update(ripemd160_state *self, const unsigned char *p, int length)
+void ripemd160_update(ripemd160_state *self, const unsigned char *p, int length)
 {
-    unsigned int bytes_needed;
+    self->length += (uint64_t)length << 3; /* length is in bits */
 
-    while (length > 0)
+    if (self->bufpos)
     {
-        /* Figure out how many bytes we need to fill the internal buffer. */
-        bytes_needed = 64 - self->bufpos;
+        /* Top up the partial block in the buffer first */
+        unsigned int bytes_needed = BLOCK_SIZE - self->bufpos;
+
+        if ((unsigned int)length < bytes_needed)
+        {
+            __memcpy(&self->buf.b[self->bufpos], p, length);
+            self->bufpos += length;
+            return;
+        }
 
-        if ((unsigned int)length >= bytes_needed)
+        __memcpy(&self->buf.b[self->bufpos], p, bytes_needed);
+        ripemd160_compress(self, self->buf.w);
+        self->bufpos = 0;
+        p += bytes_needed;
+        length -= bytes_needed;
+    }
+
+    /* Compress whole blocks in place if they are aligned, else through the buffer */
+    bool aligned = ((uintptr_t)p & 3) == 0;
+
+    while (length >= BLOCK_SIZE)
+    {
+        if (aligned)
         {
-            /* We have enough bytes, so copy them into the internal buffer and run
-             * the compression function. */
-            __memcpy(&self->buf.b[self->bufpos], p, bytes_needed);
-            self->bufpos += bytes_needed;
-            self->length += bytes_needed << 3; /* length is in bits */
-            p += bytes_needed;
-            ripemd160_compress(self);
-            length -= bytes_needed;
-            continue;
+            ripemd160_compress(self, (const message_word *)p);
+        }
+        else
+        {
+            __memcpy(self->buf.b, p, BLOCK_SIZE);
+            ripemd160_compress(self, self->buf.w);
         }
 
-        /* We do not have enough bytes to fill the internal buffer.
-         * Copy what's there and return. */
-        __memcpy(&self->buf.b[self->bufpos], p, length);
-        self->bufpos += length;
-        self->length += length << 3; /* length is in bits */
-        return;
+        p += BLOCK_SIZE;
+        length -= BLOCK_SIZE;
     }
+
+    __memcpy(self->buf.b, p, length);
+    self->bufpos = length;
 }
 
-static void ripemd160_digest(ripemd160_state *self, unsigned char *out)
+void ripemd160_final(ripemd160_state *self, unsigned char *out)
 {
     /* Append the padding */
     self->buf.b[self->bufpos++] = 0x80;
 
     if (self->bufpos > 56)
     {
-        self->bufpos = 64;
-        ripemd160_compress(self);
+        __memset(&self->buf.b[self->bufpos], 0, BLOCK_SIZE - self->bufpos);
+        ripemd160_compress(self, self->buf.w);
+        self->bufpos = 0;
     }
 
+    __memset(&self->buf.b[self->bufpos], 0, 56 - self->bufpos);
+
     /* Append the length */
     self->buf.w[14] = (uint32_t)(self->length & 0xFFFFffffu);
     self->buf.w[15] = (uint32_t)((self->length >> 32) & 0xFFFFffffu);
-    self->bufpos = 64;
-    ripemd160_compress(self);
+    ripemd160_compress(self, self->buf.w);
 
     /* Copy the final state into the output buffer */
     __memcpy(out, &self->h, RIPEMD160_DIGEST_SIZE);
@@ -344,12 +371,120 @@ void ripemd160(void *in, int inlen, void *out)
 {
     ripemd160_state state;
 
-    __memset(&state, 0, sizeof(state));
-    __memcpy(&state.h, initial_h, sizeof(initial_h));
-
+    ripemd160_init(&state);
     ripemd160_update(&state, in, inlen);
+    ripemd160_final(&state, out);
+}
+
+#ifdef TEST
+// Known answers from the RIPEMD-160 paper, hashed in one go, from unaligned memory and in pieces
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static void check(const unsigned char *p, int length, const char *expected)
+{
+    unsigned char digest[RIPEMD160_DIGEST_SIZE];
+    char hex[RIPEMD160_DIGEST_SIZE * 2 + 1];
+
+    ripemd160((void *)p, length, digest);
+
+    for (int i = 0; i < RIPEMD160_DIGEST_SIZE; i++)
+        sprintf(hex + i * 2, "%02x", digest[i]);
+
+    if (strcmp(hex, expected))
+    {
+        printf("ripemd160 of %d bytes: %s, expected %s\n", length, hex, expected);
+        abort();
+    }
+}
+
+// Hash in pieces of random length, which are at most max_piece
+static void hash_in_pieces(const unsigned char *p, int length, int max_piece, unsigned char *digest)
+{
+    ripemd160_state state;
+
+    ripemd160_init(&state);
+
+    while (length > 0)
+    {
+        int piece = rand() % (max_piece + 1);
+
+        if (piece > length)
+            piece = length;
+
+        ripemd160_update(&state, p, piece);
+        p += piece;
+        length -= piece;
+    }
+
+    ripemd160_final(&state, digest);
+}
+
+int main()
+{
+    static const struct
+    {
+        const char *message;
+        const char *digest;
+    } known[] = {
+        {"", "9c1185a5c5e9fc54612808977ee8f548b2258d31"},
+        {"a", "0bdc9d2d256b3ee9daae347be6f4dc835a467ffe"},
+        {"abc", "8eb208f7e05d987a9b044a8e98c6b087f15a0bfc"},
+        {"message digest", "5d0689ef49d2fae572b881b123a85ffa21595f36"},
+        {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "12a053384a9c0c88e405a06c27dcf49ada62eb2b"},
+        {"12345678901234567890123456789012345678901234567890123456789012345678901234567890",
+         "9b752e45573d4b39f4dbd3323cab82bf63326bfb"},
+    };
+    static unsigned char buf[1000000 + 8];
+
+    srand(102);
+
+    for (int i = 0; i < sizeof(known) / sizeof(known[0]); i++)
+    {
+        int length = strlen(known[i].message);
+
+        // at every alignment
+        for (int offset = 0; offset < 8; offset++)
+        {
+            memcpy(buf + offset, known[i].message, length);
+            check(buf + offset, length, known[i].digest);
+        }
+    }
+
+    // a million times 'a', aligned and unaligned
+    const char *million_a = "52783243c1697bdbe16d37f97f68f08325dc1528";
+
+    memset(buf, 'a', sizeof(buf));
+    check(buf, 1000000, million_a);
+    check(buf + 1, 1000000, million_a);
+    check(buf + 3, 1000000, million_a);
+
+    unsigned char digest[RIPEMD160_DIGEST_SIZE], expected[RIPEMD160_DIGEST_SIZE];
+
+    // the same in pieces, which leave the buffer partly filled and the data unaligned
+    hash_in_pieces(buf + 1, 1000000, 200, digest);
+    ripemd160(buf, 1000000, expected);
+    assert(!memcmp(digest, expected, sizeof(digest)));
+
+    // random data in pieces as against in one go
+    for (int i = 0; i < sizeof(buf); i++)
+        buf[i] = rand();
+
+    for (int round = 0; round < 10000; round++)
+    {
+        int offset = rand() % 8, length = rand() % 1000;
+
+        ripemd160(buf + offset, length, expected);
+        hash_in_pieces(buf + offset, length, rand() % 2 ? 70 : 200, digest);
+        assert(!memcmp(digest, expected, sizeof(digest)));
+    }
+
+    printf("ripemd160 ok\n");
 
-    ripemd160_digest(&state, out);
+    return 0;
 }
+#endif
 
 /* vim:set ts=4 sw=4 sts=4 expandtab: */
@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include "stdlib.h"
 #include "solana_sdk.h"
+#include "profile.h"
 
 extern uint64_t solang_dispatch(SolParameters *param);
 extern void __init_heap();
@@ -21,38 +22,240 @@ static const SolPubkey ed25519_address = {0x03, 0x7d, 0x46, 0xd6, 0x7c, 0x93, 0x
                                           0x8f, 0x83, 0x8d, 0x40, 0xff, 0x05, 0x70, 0x74, 0x49, 0x27, 0xf4,
                                           0x8a, 0x64, 0xfc, 0xca, 0x70, 0x44, 0x80, 0x00, 0x00, 0x00};
 
-#ifndef TEST
+// Like vector_hash() but unrolled for the four lanes of an address. Like address_equal(),
+// this expects the address to be aligned.
+uint64_t address_hash(uint8_t data[32])
+{
+    const word *lanes = (const word *)data;
+    uint64_t hash = 32;
 
-uint64_t entrypoint(const uint8_t *input)
+    hash = hash_lane(hash, lanes[0]);
+    hash = hash_lane(hash, lanes[1]);
+    hash = hash_lane(hash, lanes[2]);
+    hash = hash_lane(hash, lanes[3]);
+
+    return hash_finish(hash);
+}
+
+bool address_equal(void *a, void *b)
 {
-    SolParameters params;
+    uint64_t *left = a;
+    uint64_t *right = b;
 
-    uint64_t ret = sol_deserialize(input, &params);
-    if (ret)
+    for (uint32_t i = 0; i < 4; i++)
     {
-        return ret;
+        if (left[i] != right[i])
+        {
+            return false;
+        }
     }
 
-    params.ka_clock = NULL;
-    params.ka_instructions = NULL;
+    return true;
+}
+
+// The keys are hashes or ed25519 points, so folding the lanes is enough to spread them over the
+// index. Sysvar addresses share their first bytes, so all four lanes are used.
+static inline uint32_t ka_index_slot(const void *key, uint32_t mask)
+{
+    const word *lanes = key;
+    uint64_t hash = lanes[0] ^ lanes[1] ^ lanes[2] ^ lanes[3];
+
+    hash ^= hash >> 32;
+    hash ^= hash >> 16;
 
-    for (int account_no = 0; account_no < params.ka_num; account_no++)
+    return (hash ^ (hash >> 8)) & mask;
+}
+
+// Build the index over the account keys. The index has at least twice as many slots as there are
+// accounts, so there is always an empty slot to stop the probe. Duplicate accounts share the key
+// of the first one, which is the one that is found.
+static void ka_index_build(SolParameters *params)
+{
+    uint32_t slots = 16;
+
+    while (slots < 2 * params->ka_num)
+        slots *= 2;
+
+    params->ka_index = __malloc(slots * sizeof(uint16_t));
+    params->ka_index_mask = slots - 1;
+
+    for (int i = 0; i < slots; i++)
+        params->ka_index[i] = 0;
+
+    for (int account_no = 0; account_no < params->ka_num; account_no++)
     {
-        const SolAccountInfo *acc = &params.ka[account_no];
+        const SolPubkey *key = params->ka[account_no].key;
+        uint32_t slot = ka_index_slot(key, params->ka_index_mask);
 
-        if (SolPubkey_same(&clock_address, acc->key))
+        while (params->ka_index[slot])
         {
-            params.ka_clock = acc;
+            if (address_equal((void *)key, params->ka[params->ka_index[slot] - 1].key))
+                break;
+
+            slot = (slot + 1) & params->ka_index_mask;
         }
-        else if (SolPubkey_same(&instructions_address, acc->key))
+
+        if (!params->ka_index[slot])
+            params->ka_index[slot] = account_no + 1;
+    }
+}
+
+// Find the account for the given address, or return -1
+static int ka_index_lookup(const void *address, const SolParameters *params)
+{
+    uint32_t mask = params->ka_index_mask;
+
+    for (uint32_t slot = ka_index_slot(address, mask); params->ka_index[slot]; slot = (slot + 1) & mask)
+    {
+        int account_no = params->ka_index[slot] - 1;
+
+        if (address_equal((void *)address, params->ka[account_no].key))
+            return account_no;
+    }
+
+    return -1;
+}
+
+// The account metas passed on a cross program invocation list every account, in order, except
+// that the callee goes first. They are built once per invocation. Moving another callee to the
+// front only shifts the metas before it, and calling the same account again costs nothing.
+static SolAccountMeta *cpi_metas(SolParameters *params, int callee)
+{
+    SolAccountMeta *metas = params->metas;
+
+    if (!metas)
+    {
+        // There is no limit to the number of accounts, so the metas go on the heap
+        metas = __malloc(params->ka_num * sizeof(SolAccountMeta));
+
+        for (int account_no = 0; account_no < params->ka_num; account_no++)
+        {
+            SolAccountInfo *acc = &params->ka[account_no];
+
+            metas[account_no].pubkey = acc->key;
+            metas[account_no].is_writable = acc->is_writable;
+            metas[account_no].is_signer = acc->is_signer;
+        }
+
+        params->metas = metas;
+        params->metas_first = 0;
+    }
+
+    int first = params->metas_first;
+
+    if (callee != first)
+    {
+        // put the previous callee back in its place
+        SolAccountMeta meta = metas[0];
+
+        for (int meta_no = 0; meta_no < first; meta_no++)
+            metas[meta_no] = metas[meta_no + 1];
+
+        metas[first] = meta;
+
+        // Now move the callee to the front. Note that there may be duplicate
+        // entries, the order of those does not matter.
+        meta = metas[callee];
+
+        for (int meta_no = callee; meta_no > 0; meta_no--)
+            metas[meta_no] = metas[meta_no - 1];
+
+        metas[0] = meta;
+
+        params->metas_first = callee;
+    }
+
+    return metas;
+}
+
+#ifndef TEST
+
+#ifdef STDLIB_PROFILE
+bool account_data_stats(SolAccountInfo *ai, struct heap_stats *stats);
+
+static void heap_stats_log(const struct heap_stats *stats)
+{
+    sol_log_64(stats->high_water, stats->live_allocations, stats->live_bytes, stats->free_chunks,
+               stats->largest_free);
+}
+
+// Log the number of calls, the amount and the loop iterations for each helper which was called, and the usage of
+// the heap and of the account data heap of each account the program may write
+static void profile_log(SolParameters *params)
+{
+    struct profile_counter *counters = PROFILE_COUNTERS;
+    struct heap_stats stats;
+
+    sol_log("stdlib profile: helper, calls, amount, iterations");
+
+    for (uint64_t helper = 0; helper < PROFILE_HELPERS; helper++)
+    {
+        if (counters[helper].calls)
+            sol_log_64(helper, counters[helper].calls, counters[helper].amount, counters[helper].iterations, 0);
+    }
+
+    sol_log("heap: high water, allocations, bytes, free chunks, largest free");
+
+    __heap_stats(&stats);
+    heap_stats_log(&stats);
+
+    for (uint64_t i = 0; i < params->ka_num; i++)
+    {
+        SolAccountInfo *ai = &params->ka[i];
+
+        if (ai->is_writable && address_equal(ai->owner, params->program_id) && account_data_stats(ai, &stats))
         {
-            params.ka_instructions = acc;
+            sol_log_pubkey(ai->key);
+            heap_stats_log(&stats);
         }
     }
+}
+#endif
+
+uint64_t entrypoint(const uint8_t *input)
+{
+    SolParameters params;
+
+#ifdef STDLIB_PROFILE
+    for (int helper = 0; helper < PROFILE_HELPERS; helper++)
+    {
+        PROFILE_COUNTERS[helper].calls = 0;
+        PROFILE_COUNTERS[helper].amount = 0;
+        PROFILE_COUNTERS[helper].iterations = 0;
+    }
+#endif
 
     __init_heap();
 
+    // There is no limit to the number of accounts, so the account infos go on the heap
+    uint64_t ka_num = *(uint64_t *)input;
+    params.ka = __malloc(ka_num * sizeof(SolAccountInfo));
+
+    uint64_t ret = sol_deserialize(input, &params, ka_num);
+    if (ret)
+    {
+        return ret;
+    }
+
+    ka_index_build(&params);
+
+    int account_no = ka_index_lookup(&clock_address, &params);
+    params.ka_clock = account_no < 0 ? NULL : &params.ka[account_no];
+
+    account_no = ka_index_lookup(&instructions_address, &params);
+    params.ka_instructions = account_no < 0 ? NULL : &params.ka[account_no];
+    params.ed25519_index = NULL;
+    params.metas = NULL;
+
+#ifdef STDLIB_PROFILE
+    ret = solang_dispatch(&params);
+
+    profile_log(&params);
+
+    return ret;
+#else
     return solang_dispatch(&params);
+#endif
 }
 
 uint64_t sol_invoke_signed_c(const SolInstruction *instruction, const SolAccountInfo *account_infos,
@@ -63,44 +266,13 @@ uint64_t sol_invoke_signed_c(const SolInstruction *instruction, const SolAccount
 uint64_t external_call(uint8_t *input, uint32_t input_len, SolPubkey *address, SolPubkey *program_id,
                        const SolSignerSeeds *seeds, int seeds_len, SolParameters *params)
 {
-    SolAccountMeta metas[10];
-    SolInstruction instruction = {
-        .program_id = program_id,
-        .accounts = metas,
-        .account_len = params->ka_num,
-        .data = input,
-        .data_len = input_len,
-    };
-
-    int meta_no = 1;
-    int new_address_idx = -1;
-
-    for (int account_no = 0; account_no < params->ka_num; account_no++)
-    {
-        SolAccountInfo *acc = &params->ka[account_no];
-
-        // The address for the new contract should go first. Note that there
-        // may be duplicate entries, the order of those does not matter.
-        if (new_address_idx < 0 && SolPubkey_same(address, acc->key))
-        {
-            metas[0].pubkey = acc->key;
-            metas[0].is_writable = acc->is_writable;
-            metas[0].is_signer = acc->is_signer;
-            new_address_idx = account_no;
-        }
-        else
-        {
-            metas[meta_no].pubkey = acc->key;
-            metas[meta_no].is_writable = acc->is_writable;
-            metas[meta_no].is_signer = acc->is_signer;
-            meta_no += 1;
-        }
-    }
+    int new_address_idx = ka_index_lookup(address, params);
 
-    // If the program_id is null, we are dealing with an external call
-    if (!program_id)
+    if (new_address_idx < 0)
     {
-        if (new_address_idx < 0)
+        // If the program_id is null, we are dealing with an external call,
+        // otherwise this is a constructor call
+        if (!program_id)
         {
             sol_log("call to account not in transaction");
             sol_panic();
@@ -108,38 +280,40 @@ uint64_t external_call(uint8_t *input, uint32_t input_len, SolPubkey *address, S
             return ERROR_INVALID_ACCOUNT_DATA;
         }
         else
-        {
-            instruction.program_id = params->ka[new_address_idx].owner;
-            return sol_invoke_signed_c(&instruction, params->ka, params->ka_num, NULL, 0);
-        }
-    }
-    else
-    {
-        // This is a constructor call
-        if (new_address_idx < 0)
         {
             sol_log("new account needed");
             sol_panic();
 
             return ERROR_NEW_ACCOUNT_NEEDED;
         }
-        else
-        {
-            return sol_invoke_signed_c(&instruction, params->ka, params->ka_num, seeds, seeds_len);
-        }
     }
+
+    SolInstruction instruction = {
+        .program_id = program_id ? program_id : params->ka[new_address_idx].owner,
+        .accounts = cpi_metas(params, new_address_idx),
+        .account_len = params->ka_num,
+        .data = input,
+        .data_len = input_len,
+    };
+
+    // only the constructor call is signed with the seeds
+    if (!program_id)
+    {
+        seeds = NULL;
+        seeds_len = 0;
+    }
+
+    return sol_invoke_signed_c(&instruction, params->ka, params->ka_num, seeds, seeds_len);
 }
 
 uint64_t *sol_account_lamport(uint8_t *address, SolParameters *params)
 {
     SolPubkey *pubkey = (SolPubkey *)address;
+    int account_no = ka_index_lookup(address, params);
 
-    for (int i = 0; i < params->ka_num; i++)
+    if (account_no >= 0)
     {
-        if (SolPubkey_same(pubkey, params->ka[i].key))
-        {
-            return params->ka[i].lamports;
-        }
+        return params->ka[account_no].lamports;
     }
 
     sol_log_pubkey(pubkey);
@@ -193,35 +367,9 @@ bool sol_try_transfer(uint8_t *to_address, uint64_t lamports, SolParameters *par
 
 #endif
 
-uint64_t address_hash(uint8_t data[32])
-{
-    uint64_t hash = 0;
-    uint32_t i;
-
-    for (i = 0; i < 32; i++)
-    {
-        hash += data[i];
-    }
-
-    return hash;
-}
-
-bool address_equal(void *a, void *b)
-{
-    uint64_t *left = a;
-    uint64_t *right = b;
-
-    for (uint32_t i = 0; i < 4; i++)
-    {
-        if (left[i] != right[i])
-        {
-            return false;
-        }
-    }
-
-    return true;
-}
+extern bool __memcmp(uint8_t *left, uint32_t left_len, uint8_t *right, uint32_t right_len);
 
+// The offsets of a signature, its public key and its message, in the data of the ed25519 instruction
 struct ed25519_instruction_sig
 {
     uint16_t signature_offset;
@@ -231,9 +379,6 @@ struct ed25519_instruction_sig
     uint16_t message_offset;
     uint16_t message_size;
     uint16_t message_instruction_index;
-    uint8_t public_key[SIZE_PUBKEY];
-    uint8_t signature[64];
-    uint8_t message[0];
 };
 
 struct ed25519_instruction
@@ -243,72 +388,161 @@ struct ed25519_instruction
     struct ed25519_instruction_sig sig[0];
 };
 
-uint64_t signature_verify(uint8_t *public_key, struct vector *message, struct vector *signature, SolParameters *params)
+struct ed25519_entry
+{
+    uint8_t *instr;
+    struct ed25519_instruction_sig *sig;
+};
+
+// Open addressing hash index of the ed25519 signatures in the instructions sysvar, by public key
+struct ed25519_index
+{
+    uint32_t mask;
+    struct ed25519_entry entry[0];
+};
+
+// Public keys are points on the curve, so their first bytes are as good as a hash. They are at
+// any alignment in the instruction.
+static inline uint32_t ed25519_slot(const uint8_t *public_key, uint32_t mask)
 {
-    if (params->ka_instructions)
+    return (public_key[0] | (public_key[1] << 8) | (public_key[2] << 16)) & mask;
+}
+
+// Visit the signatures of each ed25519 instruction in the instructions sysvar which only refer to
+// their own instruction, and add them to the index. If the index is NULL, just count them.
+static uint32_t ed25519_walk(const SolAccountInfo *ka_instructions, struct ed25519_index *index)
+{
+    uint16_t *data = (uint16_t *)ka_instructions->data;
+    uint64_t instr_count = data[0];
+    uint32_t count = 0;
+
+    // for each instruction
+    for (uint64_t instr_no = 0; instr_no < instr_count; instr_no++)
     {
-        uint16_t *data = (uint16_t *)params->ka_instructions->data;
+        uint8_t *instr = ka_instructions->data + data[1 + instr_no];
 
-        uint64_t instr_count = data[0];
+        // step over the accounts
+        uint64_t accounts = *((uint16_t *)instr);
 
-        // for each instruction
-        for (uint64_t instr_no = 0; instr_no < instr_count; instr_no++)
+        instr += accounts * 33 + 2;
+
+        if (!__memcmp(instr, SIZE_PUBKEY, (uint8_t *)&ed25519_address, SIZE_PUBKEY))
         {
-            uint8_t *instr = params->ka_instructions->data + data[1 + instr_no];
+            continue;
+        }
 
-            // step over the accounts
-            uint64_t accounts = *((uint16_t *)instr);
+        // step over program_id and length
+        instr += 2 + 32;
 
-            instr += accounts * 33 + 2;
+        struct ed25519_instruction *ed25519 = (struct ed25519_instruction *)instr;
 
-            if (sol_memcmp(&ed25519_address, instr, sizeof(ed25519_address)))
-            {
+        for (uint64_t sig_no = 0; sig_no < ed25519->num_signatures; sig_no++)
+        {
+            struct ed25519_instruction_sig *sig = &ed25519->sig[sig_no];
+
+            if (sig->public_key_instruction_index != instr_no || sig->signature_instruction_index != instr_no ||
+                sig->message_instruction_index != instr_no)
                 continue;
+
+            if (index)
+            {
+                uint32_t slot = ed25519_slot(instr + sig->public_key_offset, index->mask);
+
+                while (index->entry[slot].instr)
+                    slot = (slot + 1) & index->mask;
+
+                index->entry[slot].instr = instr;
+                index->entry[slot].sig = sig;
             }
 
-            // step over program_id and length
-            instr += 2 + 32;
+            count++;
+        }
+    }
 
-            struct ed25519_instruction *ed25519 = (struct ed25519_instruction *)instr;
+    return count;
+}
 
-            for (uint64_t sig_no = 0; sig_no < ed25519->num_signatures; sig_no++)
-            {
-                struct ed25519_instruction_sig *sig = &ed25519->sig[sig_no];
+// The instructions sysvar is parsed once per invocation, on first use
+static struct ed25519_index *ed25519_index(SolParameters *params)
+{
+    if (!params->ed25519_index && params->ka_instructions)
+    {
+        // at least twice as many slots as signatures, so there is always an empty slot
+        uint32_t count = ed25519_walk(params->ka_instructions, NULL);
+        uint32_t slots = 4;
 
-                if (sig->public_key_instruction_index != instr_no || sig->signature_instruction_index != instr_no ||
-                    sig->message_instruction_index != instr_no)
-                    continue;
+        while (slots < 2 * count)
+            slots *= 2;
 
-                if (sol_memcmp(public_key, instr + sig->public_key_offset, SIZE_PUBKEY))
-                {
-                    continue;
-                }
+        struct ed25519_index *index = __malloc(sizeof(struct ed25519_index) + slots * sizeof(struct ed25519_entry));
 
-                if (sol_memcmp(signature->data, instr + sig->signature_offset, 64))
-                {
-                    continue;
-                }
+        index->mask = slots - 1;
 
-                if (sig->message_size != message->len)
-                {
-                    continue;
-                }
+        for (uint32_t i = 0; i < slots; i++)
+            index->entry[i].instr = NULL;
 
-                if (sol_memcmp(message->data, instr + sig->message_offset, message->len))
-                {
-                    continue;
-                }
+        ed25519_walk(params->ka_instructions, index);
 
-                return 0;
-            }
+        params->ed25519_index = index;
+    }
+
+    return params->ed25519_index;
+}
+
+static bool ed25519_verified(struct ed25519_index *index, uint8_t *public_key, struct vector *message,
+                             struct vector *signature)
+{
+    for (uint32_t slot = ed25519_slot(public_key, index->mask); index->entry[slot].instr;
+         slot = (slot + 1) & index->mask)
+    {
+        uint8_t *instr = index->entry[slot].instr;
+        struct ed25519_instruction_sig *sig = index->entry[slot].sig;
+
+        if (__memcmp(public_key, SIZE_PUBKEY, instr + sig->public_key_offset, SIZE_PUBKEY) &&
+            __memcmp(signature->data, signature->len, instr + sig->signature_offset, 64) &&
+            __memcmp(message->data, message->len, instr + sig->message_offset, sig->message_size))
+        {
+            return true;
         }
     }
 
+    return false;
+}
+
+uint64_t signature_verify(uint8_t *public_key, struct vector *message, struct vector *signature, SolParameters *params)
+{
+    struct ed25519_index *index = ed25519_index(params);
+
+    if (index && ed25519_verified(index, public_key, message, signature))
+    {
+        return 0;
+    }
+
     sol_log("could not find verified signature");
 
     return 1;
 }
 
+// Check a batch of signatures, each of which must have been verified by an ed25519 instruction
+// in this transaction
+uint64_t signature_verify_batch(uint32_t count, uint8_t *public_keys[], struct vector *messages[],
+                                struct vector *signatures[], SolParameters *params)
+{
+    struct ed25519_index *index = ed25519_index(params);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (!index || !ed25519_verified(index, public_keys[i], messages[i], signatures[i]))
+        {
+            sol_log("could not find verified signature");
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
 struct clock_layout
 {
     uint64_t slot;
@@ -334,8 +568,10 @@ struct clock_layout *sol_clock(SolParameters *params)
 struct account_data_header
 {
     uint32_t magic;
-    uint32_t returndata_len;
-    uint32_t returndata_offset;
+    // These were the return data length and offset, which are no longer used. Accounts written
+    // by older versions have zero here, which means the free list has not been built yet.
+    uint32_t heap_last;
+    uint32_t heap_free;
     uint32_t heap_offset;
 };
 
@@ -346,6 +582,12 @@ struct account_data_header
 // time it is called.
 // We don't expect the account data to exceed 4GB so we use 32 bit offsets.
 // The account data can grow so the last entry always has length = 0 and offset_next = 0.
+// Extending the heap past the end of the account data grows the account, up to what the
+// runtime permits in one instruction.
+//
+// Allocation should not have to walk past every allocated object, so the free objects are also
+// on a doubly-linked free list, starting at heap_free. The links are kept in the payload of the
+// free object, which is always at least 8 bytes. heap_last is the offset of the last entry.
 struct chunk
 {
     uint32_t offset_next, offset_prev;
@@ -353,100 +595,232 @@ struct chunk
     uint32_t allocated;
 };
 
+struct free_links
+{
+    uint32_t next_free, prev_free;
+};
+
 #define ROUND_UP(n, d) (((n) + (d)-1) & ~(d - 1))
 
+// Number of free objects account_data_alloc() looks at after the first one which fits
+#define BEST_FIT_SCAN 8
+
+static inline struct free_links *free_links(void *data, uint32_t offset)
+{
+    return data + offset + sizeof(struct chunk);
+}
+
+static void free_list_insert(void *data, uint32_t offset)
+{
+    struct account_data_header *hdr = data;
+    struct free_links *links = free_links(data, offset);
+
+    links->next_free = hdr->heap_free;
+    links->prev_free = 0;
+
+    if (hdr->heap_free)
+        free_links(data, hdr->heap_free)->prev_free = offset;
+
+    hdr->heap_free = offset;
+}
+
+static void free_list_remove(void *data, uint32_t offset)
+{
+    struct account_data_header *hdr = data;
+    struct free_links *links = free_links(data, offset);
+
+    if (links->next_free)
+        free_links(data, links->next_free)->prev_free = links->prev_free;
+
+    if (links->prev_free)
+        free_links(data, links->prev_free)->next_free = links->next_free;
+    else
+        hdr->heap_free = links->next_free;
+}
+
+// Set the offset_prev of the chunk at offset
+static inline void set_prev(void *data, uint32_t offset, uint32_t offset_prev)
+{
+    struct chunk *chunk = data + offset;
+
+    chunk->offset_prev = offset_prev;
+}
+
+// Build the free list for an account written by an older version. This walks the heap once.
+static void account_data_index(void *data)
+{
+    struct account_data_header *hdr = data;
+
+    if (hdr->heap_last)
+        return;
+
+    uint32_t offset = hdr->heap_offset;
+
+    hdr->heap_free = 0;
+
+    for (;;)
+    {
+        struct chunk *chunk = data + offset;
+
+        if (!chunk->offset_next)
+            break;
+
+        if (!chunk->allocated)
+        {
+            // older versions did not always update the length of free objects
+            chunk->length = chunk->offset_next - offset - sizeof(struct chunk);
+            free_list_insert(data, offset);
+        }
+
+        offset = chunk->offset_next;
+    }
+
+    hdr->heap_last = offset;
+}
+
+// The free object at offset has become the last entry
+static inline void set_last(void *data, uint32_t offset, uint32_t offset_prev)
+{
+    struct account_data_header *hdr = data;
+    struct chunk *chunk = data + offset;
+
+    chunk->offset_prev = offset_prev;
+    chunk->offset_next = 0;
+    chunk->length = 0;
+    chunk->allocated = false;
+
+    hdr->heap_last = offset;
+}
+
+// Create a free object at offset which extends to offset_next
+static void insert_free(void *data, uint32_t offset, uint32_t offset_prev, uint32_t offset_next)
+{
+    struct chunk *chunk = data + offset;
+
+    chunk->offset_prev = offset_prev;
+    chunk->offset_next = offset_next;
+    chunk->length = offset_next - offset - sizeof(struct chunk);
+    chunk->allocated = false;
+
+    set_prev(data, offset_next, offset);
+    free_list_insert(data, offset);
+}
+
+// Minimum balance for an account with data_len bytes of data to be rent exempt, like minimum_balance()
+// in solana-library/minimum_balance.sol
+static inline uint64_t rent_exempt_minimum(uint64_t data_len)
+{
+    return (ACCOUNT_STORAGE_OVERHEAD + data_len) * DEFAULT_LAMPORTS_PER_BYTE_YEAR * DEFAULT_EXEMPTION_THRESHOLD;
+}
+
+// Make sure the heap can extend to end. When the account data is too short, it is grown in
+// place: the runtime serializes MAX_PERMITTED_DATA_INCREASE bytes of zeroed space after the data
+// of each account, so only the length in the input and in the account info have to change.
+// The runtime fails the transaction if the account is no longer rent exempt once it has grown,
+// so the account must already hold enough lamports for the new length.
+static bool account_data_reserve(SolAccountInfo *ai, uint32_t end)
+{
+    if (end < ai->data_len)
+        return true;
+
+    uint64_t new_len = ROUND_UP((uint64_t)end + 1, 8);
+    // sol_deserialize() keeps the length on entry in the padding before the key
+    uint32_t original_data_len = ((uint32_t *)ai->key)[-1];
+
+    if (!ai->is_writable || new_len > original_data_len + MAX_PERMITTED_DATA_INCREASE ||
+        new_len > MAX_PERMITTED_DATA_LENGTH || *ai->lamports < rent_exempt_minimum(new_len))
+        return false;
+
+    ((uint64_t *)ai->data)[-1] = new_len;
+    ai->data_len = new_len;
+
+    return true;
+}
+
 uint64_t account_data_alloc(SolAccountInfo *ai, uint32_t size, uint32_t *res)
 {
     void *data = ai->data;
     struct account_data_header *hdr = data;
 
+    PROFILE(PROFILE_ACCOUNT_ALLOC, size);
+
     if (!size)
     {
         *res = 0;
         return 0;
     }
 
-    uint32_t offset = hdr->heap_offset;
+    account_data_index(data);
 
     uint32_t alloc_size = ROUND_UP(size, 8);
 
-    uint32_t offset_prev = 0;
+    // Best fit leaves the larger free objects whole for larger allocations, which fragments the
+    // heap less than first fit. A free object which is too small to split is as good as an exact
+    // fit, so stop there. So that allocating does not walk the whole free list, only the next
+    // BEST_FIT_SCAN free objects after the first one that fits are considered.
+    uint32_t offset = 0, best_length = UINT32_MAX, scanned = 0;
 
-    for (;;)
+    for (uint32_t free = hdr->heap_free; free; free = free_links(data, free)->next_free)
     {
-        struct chunk *chunk = data + offset;
+        uint32_t length = ((struct chunk *)(data + free))->length;
 
-        if (!chunk->allocated)
-        {
-            if (!chunk->length)
-            {
-                offset += sizeof(struct chunk);
+        PROFILE_LOOP(PROFILE_ACCOUNT_ALLOC);
 
-                if (offset + alloc_size + sizeof(struct chunk) >= ai->data_len)
-                {
-                    return ERROR_ACCOUNT_DATA_TOO_SMALL;
-                }
+        if (offset && ++scanned > BEST_FIT_SCAN)
+            break;
 
-                chunk->offset_next = offset + alloc_size;
-                chunk->offset_prev = offset_prev;
-                chunk->allocated = true;
-                chunk->length = size;
+        if (length >= alloc_size && length < best_length)
+        {
+            offset = free;
+            best_length = length;
+
+            if (length < alloc_size + sizeof(struct chunk) + 8)
+                break;
+        }
+    }
 
-                struct chunk *next = data + chunk->offset_next;
+    if (offset)
+    {
+        struct chunk *chunk = data + offset;
 
-                next->offset_prev = offset - sizeof(struct chunk);
-                next->length = 0;
-                next->offset_next = 0;
-                next->allocated = false;
+        free_list_remove(data, offset);
 
-                *res = offset;
-                return 0;
-            }
-            else if (chunk->length < alloc_size)
-            {
-                // too small
-            }
-            else if (alloc_size + sizeof(struct chunk) + 8 > chunk->length)
-            {
-                // just right
-                chunk->allocated = true;
-                chunk->length = size;
+        if (alloc_size + sizeof(struct chunk) + 8 <= chunk->length)
+        {
+            // too big, split
+            uint32_t next_offset = offset + sizeof(struct chunk) + alloc_size;
 
-                *res = offset + sizeof(struct chunk);
-                return 0;
-            }
-            else
-            {
-                // too big, split
-                uint32_t next = chunk->offset_next;
-                uint32_t prev = offset;
+            insert_free(data, next_offset, offset, chunk->offset_next);
 
-                uint32_t next_offset = offset + sizeof(struct chunk) + alloc_size;
+            chunk->offset_next = next_offset;
+        }
 
-                chunk->offset_next = next_offset;
-                chunk->length = size;
-                chunk->allocated = true;
+        chunk->length = size;
+        chunk->allocated = true;
 
-                chunk = data + next_offset;
-                chunk->offset_prev = prev;
-                chunk->offset_next = next;
-                chunk->length = next - next_offset - sizeof(struct chunk);
-                chunk->allocated = false;
+        *res = offset + sizeof(struct chunk);
+        return 0;
+    }
 
-                if (next)
-                {
-                    struct chunk *chunk = data + next;
-                    chunk->offset_prev = next_offset;
-                }
+    // nothing on the free list fits, so extend the heap
+    offset = hdr->heap_last;
+    struct chunk *chunk = data + offset;
 
-                *res = offset + sizeof(struct chunk);
-                return 0;
-            }
-        }
+    offset += sizeof(struct chunk);
 
-        offset_prev = offset;
-        offset = chunk->offset_next;
+    if (!account_data_reserve(ai, offset + alloc_size + sizeof(struct chunk)))
+    {
+        return ERROR_ACCOUNT_DATA_TOO_SMALL;
     }
+
+    chunk->offset_next = offset + alloc_size;
+    chunk->allocated = true;
+    chunk->length = size;
+
+    set_last(data, chunk->offset_next, offset - sizeof(struct chunk));
+
+    *res = offset;
+    return 0;
 }
 
 uint32_t account_data_len(void *data, uint32_t offset)
@@ -468,70 +842,54 @@ void account_data_free(void *data, uint32_t offset)
     if (!offset)
         return;
 
+    account_data_index(data);
+
     offset -= sizeof(struct chunk);
 
     struct chunk *chunk = data + offset;
+    uint32_t offset_prev = chunk->offset_prev;
+    uint32_t offset_next = chunk->offset_next;
 
-    chunk->allocated = false;
+    PROFILE(PROFILE_ACCOUNT_FREE, chunk->length);
 
-    // merge with previous chunk?
-    if (chunk->offset_prev)
-    {
-        struct chunk *prev = data + chunk->offset_prev;
-
-        if (!prev->allocated)
-        {
-            // merge
-            offset = chunk->offset_prev;
-
-            if (chunk->offset_next)
-            {
-                prev->length = chunk->offset_next - offset - sizeof(struct chunk);
-                prev->offset_next = chunk->offset_next;
-
-                struct chunk *next = data + chunk->offset_next;
-
-                next->offset_prev = offset;
-            }
-            else
-            {
-                prev->offset_next = 0;
-                prev->length = 0;
-            }
+    // merge with previous chunk?
+    if (offset_prev)
+    {
+        struct chunk *prev = data + offset_prev;
+
+        if (!prev->allocated)
+        {
+            free_list_remove(data, offset_prev);
 
-            chunk = prev;
+            offset = offset_prev;
+            offset_prev = prev->offset_prev;
         }
     }
 
     // merge with next chunk?
-    if (chunk->offset_next)
-    {
-        struct chunk *next = data + chunk->offset_next;
+    struct chunk *next = data + offset_next;
 
-        if (!next->allocated)
+    if (!next->allocated)
+    {
+        if (!next->offset_next)
         {
-            // merge
-            if (next->offset_next)
-            {
-                chunk->offset_next = next->offset_next;
-
-                chunk->length = chunk->offset_next - offset - sizeof(struct chunk);
+            // this is the end of the heap now
+            set_last(data, offset, offset_prev);
+            return;
+        }
 
-                struct chunk *next = data + chunk->offset_next;
+        free_list_remove(data, offset_next);
 
-                next->offset_prev = offset;
-            }
-            else
-            {
-                chunk->offset_next = 0;
-                chunk->length = 0;
-            }
-        }
+        offset_next = next->offset_next;
     }
+
+    insert_free(data, offset, offset_prev, offset_next);
 }
 
 uint64_t account_data_realloc(SolAccountInfo *ai, uint32_t offset, uint32_t size, uint32_t *res)
 {
+    PROFILE(PROFILE_ACCOUNT_REALLOC, size);
+
     if (!size)
     {
         account_data_free(ai->data, offset);
@@ -546,12 +904,15 @@ uint64_t account_data_realloc(SolAccountInfo *ai, uint32_t offset, uint32_t size
 
     void *data = ai->data;
 
+    account_data_index(data);
+
     uint32_t chunk_offset = offset - sizeof(struct chunk);
 
     struct chunk *chunk = data + chunk_offset;
-    struct chunk *next = data + chunk->offset_next;
+    uint32_t next_offset = chunk->offset_next;
+    struct chunk *next = data + next_offset;
 
-    uint32_t existing_size = chunk->offset_next - offset;
+    uint32_t existing_size = next_offset - offset;
     uint32_t alloc_size = ROUND_UP(size, 8);
 
     // 1. Is the existing chunk big enough
@@ -564,49 +925,25 @@ uint64_t account_data_realloc(SolAccountInfo *ai, uint32_t offset, uint32_t size
         {
             uint32_t new_next_offset = offset + alloc_size;
 
-            if (!next->allocated)
-            {
-                // merge with next chunk
-                if (!next->offset_next)
-                {
-                    // the trailing free chunk
-                    chunk->offset_next = new_next_offset;
-                    next = data + new_next_offset;
-                    next->offset_prev = chunk_offset;
-                    next->offset_next = 0;
-                    next->allocated = false;
-                    next->length = 0;
-                }
-                else
-                {
-                    // merge with next chunk
-                    chunk->offset_next = new_next_offset;
-                    uint32_t offset_next_next = next->offset_next;
-
-                    next = data + new_next_offset;
-                    next->offset_prev = chunk_offset;
-                    next->offset_next = offset_next_next;
-                    next->allocated = false;
-                    next->length = offset_next_next - new_next_offset - sizeof(struct chunk);
+            chunk->offset_next = new_next_offset;
 
-                    next = data + offset_next_next;
-                    next->offset_prev = new_next_offset;
-                }
+            if (!next->allocated && !next->offset_next)
+            {
+                // the trailing free chunk moves down
+                set_last(data, new_next_offset, chunk_offset);
             }
             else
             {
-                // insert a new chunk
-                uint32_t offset_next_next = chunk->offset_next;
-
-                chunk->offset_next = new_next_offset;
-                next = data + new_next_offset;
-                next->offset_prev = chunk_offset;
-                next->offset_next = offset_next_next;
-                next->allocated = false;
-                next->length = offset_next_next - new_next_offset - sizeof(struct chunk);
-
-                next = data + offset_next_next;
-                next->offset_prev = new_next_offset;
+                uint32_t offset_next_next = next_offset;
+
+                if (!next->allocated)
+                {
+                    // merge with next chunk
+                    free_list_remove(data, next_offset);
+                    offset_next_next = next->offset_next;
+                }
+
+                insert_free(data, new_next_offset, chunk_offset, offset_next_next);
             }
         }
 
@@ -619,37 +956,29 @@ uint64_t account_data_realloc(SolAccountInfo *ai, uint32_t offset, uint32_t size
     // neighbours.
     if (!next->allocated)
     {
-        if (next->offset_next)
+        uint32_t offset_next_next = next->offset_next;
+
+        if (offset_next_next)
         {
-            uint32_t merged_size = next->offset_next - offset;
+            uint32_t merged_size = offset_next_next - offset;
 
             if (size < merged_size)
             {
+                free_list_remove(data, next_offset);
+
+                chunk->length = size;
+
                 if (merged_size - alloc_size < 8 + sizeof(struct chunk))
                 {
                     // merge the two chunks
-                    chunk->offset_next = next->offset_next;
-                    chunk->length = size;
-                    next = data + chunk->offset_next;
-                    next->offset_prev = chunk_offset;
+                    chunk->offset_next = offset_next_next;
+                    set_prev(data, offset_next_next, chunk_offset);
                 }
                 else
                 {
                     // expand our chunk to fit and shrink the next chunk
-                    uint32_t offset_next = offset + alloc_size;
-                    uint32_t offset_next_next = next->offset_next;
-
-                    chunk->offset_next = offset_next;
-                    chunk->length = size;
-
-                    next = data + offset_next;
-                    next->offset_prev = chunk_offset;
-                    next->offset_next = offset_next_next;
-                    next->length = offset_next_next - offset_next - sizeof(struct chunk);
-                    next->allocated = false;
-
-                    next = data + offset_next_next;
-                    next->offset_prev = offset_next;
+                    chunk->offset_next = offset + alloc_size;
+                    insert_free(data, chunk->offset_next, chunk_offset, offset_next_next);
                 }
 
                 *res = offset;
@@ -658,17 +987,13 @@ uint64_t account_data_realloc(SolAccountInfo *ai, uint32_t offset, uint32_t size
         }
         else
         {
-            if (offset + alloc_size + sizeof(struct chunk) < ai->data_len)
+            // the last object grows in place, growing the account if needed
+            if (account_data_reserve(ai, offset + alloc_size + sizeof(struct chunk)))
             {
                 chunk->offset_next = offset + alloc_size;
                 chunk->length = size;
 
-                next = data + chunk->offset_next;
-
-                next->offset_prev = chunk_offset;
-                next->offset_next = 0;
-                next->allocated = false;
-                next->length = 0;
+                set_last(data, chunk->offset_next, chunk_offset);
 
                 *res = offset;
                 return 0;
@@ -689,6 +1014,58 @@ uint64_t account_data_realloc(SolAccountInfo *ai, uint32_t offset, uint32_t size
     return 0;
 }
 
+// Usage of the heap in the account data. The account may not have been written by us, so
+// every offset is checked against the length. Returns false if the heap is not valid.
+bool account_data_stats(SolAccountInfo *ai, struct heap_stats *stats)
+{
+    void *data = ai->data;
+    struct account_data_header *hdr = data;
+    uint32_t offset = hdr->heap_offset;
+
+    stats->live_allocations = 0;
+    stats->live_bytes = 0;
+    stats->free_chunks = 0;
+    stats->largest_free = 0;
+
+    if (ai->data_len < sizeof(struct account_data_header) || offset < sizeof(struct account_data_header))
+        return false;
+
+    for (;;)
+    {
+        struct chunk *chunk = data + offset;
+
+        if (offset + sizeof(struct chunk) > ai->data_len)
+            return false;
+
+        if (!chunk->offset_next)
+            break;
+
+        if (chunk->offset_next <= offset)
+            return false;
+
+        uint32_t length = chunk->offset_next - offset - sizeof(struct chunk);
+
+        if (chunk->allocated)
+        {
+            stats->live_allocations++;
+            stats->live_bytes += chunk->length;
+        }
+        else
+        {
+            stats->free_chunks++;
+            if (length > stats->largest_free)
+                stats->largest_free = length;
+        }
+
+        offset = chunk->offset_next;
+    }
+
+    // the last entry is where the heap would be extended
+    stats->high_water = offset + sizeof(struct chunk);
+
+    return true;
+}
+
 #ifdef TEST
 // To run the test:
 // clang -DTEST -DSOL_TEST -O3 -Wall solana.c stdlib.c -o test && ./test
@@ -697,12 +1074,59 @@ uint64_t account_data_realloc(SolAccountInfo *ai, uint32_t offset, uint32_t size
 #include <stdlib.h>
 #include <time.h>
 
+// Check the free list holds exactly the free objects, and return how many there are
+static uint32_t validate_free_list(void *data)
+{
+    struct account_data_header *hdr = data;
+    uint32_t count = 0, prev_free = 0;
+
+    for (uint32_t offset = hdr->heap_free; offset; offset = free_links(data, offset)->next_free)
+    {
+        struct chunk *chk = data + offset;
+
+        assert(!chk->allocated && chk->offset_next != 0);
+        assert(chk->length == chk->offset_next - offset - sizeof(struct chunk));
+        assert(free_links(data, offset)->prev_free == prev_free);
+
+        prev_free = offset;
+        count++;
+    }
+
+    return count;
+}
+
+// The average fragmentation over FRAGMENTATION_STEPS steps of the random test, starting from
+// FRAGMENTATION_SEED. First fit gives 292/1000 and best fit 253/1000.
+#define FRAGMENTATION_SEED 1
+#define FRAGMENTATION_STEPS 100000
+#define BEST_FIT_FRAGMENTATION 270
+
+// Fragmentation of the heap: the share of the space between the first and the last entry which
+// is free, in thousandths. The free space at the end is not counted, since it is not part of the
+// account data.
+static uint32_t heap_fragmentation(void *data)
+{
+    struct account_data_header *hdr = data;
+    uint32_t free = 0, offset = hdr->heap_offset, last = offset;
+
+    for (struct chunk *chk = data + offset; chk->offset_next; chk = data + offset)
+    {
+        if (!chk->allocated)
+            free += chk->offset_next - offset;
+
+        offset = chk->offset_next;
+        last = offset;
+    }
+
+    return last == hdr->heap_offset ? 0 : (uint64_t)free * 1000 / (last - hdr->heap_offset);
+}
+
 void validate_heap(void *data, uint32_t offs[100], uint32_t lens[100])
 {
     struct account_data_header *hdr = data;
     uint32_t offset = hdr->heap_offset;
 
-    uint32_t last_offset = 0;
+    uint32_t last_offset = 0, free_count = 0;
 
     for (;;)
     {
@@ -713,6 +1137,11 @@ void validate_heap(void *data, uint32_t offs[100], uint32_t lens[100])
         {
             assert(chk->length == 0 && chk->offset_next == 0 && chk->offset_prev == last_offset);
             // printf("last object at 0x%08x\n", offset);
+            if (hdr->heap_last)
+            {
+                assert(hdr->heap_last == offset);
+                assert(validate_free_list(data) == free_count);
+            }
             return;
         }
 
@@ -751,6 +1180,7 @@ void validate_heap(void *data, uint32_t offs[100], uint32_t lens[100])
             {
                 assert(offs[i] != off);
             }
+            free_count++;
         }
 
         last_offset = offset;
@@ -758,33 +1188,464 @@ void validate_heap(void *data, uint32_t offs[100], uint32_t lens[100])
     }
 }
 
+extern bool __memcmp(uint8_t *left, uint32_t left_len, uint8_t *right, uint32_t right_len);
+extern int __memcmp_ord(uint8_t *a, uint8_t *b, uint32_t len);
+
+// Check the memory kernels against the C library for all alignments and short lengths
+void test_memory_kernels()
+{
+    uint8_t src[128], dest[128], expected[128];
+
+    for (int i = 0; i < sizeof(src); i++)
+        src[i] = rand();
+
+    for (int d = 0; d < 8; d++)
+    {
+        for (int s = 0; s < 8; s++)
+        {
+            for (int len = 0; len < 100; len++)
+            {
+                memset(dest, 0xee, sizeof(dest));
+                memcpy(expected, dest, sizeof(dest));
+                memcpy(expected + d, src + s, len);
+                __memcpy(dest + d, src + s, len);
+                assert(memcmp(dest, expected, sizeof(dest)) == 0);
+
+                assert(__memcmp(dest + d, len, src + s, len));
+                assert(__memcmp_ord(dest + d, src + s, len) == 0);
+
+                if (len > 0)
+                {
+                    int pos = rand() % len;
+                    dest[d + pos] ^= 0x80;
+                    assert(!__memcmp(dest + d, len, src + s, len));
+                    int ord = __memcmp_ord(dest + d, src + s, len);
+                    int expected_ord = memcmp(dest + d, src + s, len);
+                    assert((ord < 0) == (expected_ord < 0) && (ord > 0) == (expected_ord > 0));
+                }
+
+                memset(expected + d, s, len);
+                __memset(dest + d, s, len);
+                assert(memcmp(dest, expected, sizeof(dest)) == 0);
+            }
+        }
+    }
+
+    // overlapping copy down
+    for (int i = 0; i < sizeof(src); i++)
+        dest[i] = i;
+
+    __memcpy(dest, dest + 3, 120);
+
+    for (int i = 0; i < 120; i++)
+        assert(dest[i] == i + 3);
+}
+
+extern void __be32toleN(uint8_t *from, uint8_t *to, uint32_t length);
+extern void __beNtoleN(uint8_t *from, uint8_t *to, uint32_t length);
+extern void __leNtobe32(uint8_t *from, uint8_t *to, uint32_t length);
+extern void __leNtobeN(uint8_t *from, uint8_t *to, uint32_t length);
+
+// Check the byte order conversions for all alignments and widths
+void test_byte_order()
+{
+    uint64_t src_storage[6], dest_storage[6];
+    uint8_t *src = (uint8_t *)src_storage, *dest = (uint8_t *)dest_storage;
+
+    for (int i = 0; i < sizeof(src_storage); i++)
+        src[i] = rand();
+
+    for (int d = 0; d < 8; d++)
+    {
+        for (int s = 0; s < 8; s++)
+        {
+            for (int len = 1; len <= 32; len++)
+            {
+                __beNtoleN(src + s, dest + d, len);
+                for (int i = 0; i < len; i++)
+                    assert(dest[d + i] == src[s + len - 1 - i]);
+
+                __leNtobeN(src + s, dest + d, len);
+                for (int i = 0; i < len; i++)
+                    assert(dest[d + len - 1 - i] == src[s + i]);
+
+                __be32toleN(src + s, dest + d, len);
+                for (int i = 0; i < len; i++)
+                    assert(dest[d + i] == src[s + 31 - i]);
+
+                memset(dest, 0xee, sizeof(dest_storage));
+                __leNtobe32(src + s, dest + d, len);
+                for (int i = 0; i < 32; i++)
+                    assert(dest[d + 31 - i] == (i < len ? src[s + i] : 0xee));
+            }
+        }
+    }
+}
+
+extern uint64_t vector_hash(struct vector *v);
+
+#define BUCKETS 251
+
+// Check that keys which differ a little spread evenly over the mapping buckets
+void check_buckets(uint32_t buckets[BUCKETS], uint32_t keys)
+{
+    uint32_t max = 0;
+
+    for (int i = 0; i < BUCKETS; i++)
+        if (buckets[i] > max)
+            max = buckets[i];
+
+    // the expected maximum for uniform hashing is well below twice the mean
+    assert(max < 2 * keys / BUCKETS);
+}
+
+void test_hashes()
+{
+    uint32_t buckets[BUCKETS];
+    uint64_t address_storage[4];
+    uint8_t *address = (uint8_t *)address_storage;
+    struct vector *v = malloc(sizeof(struct vector) + 64);
+    const uint32_t keys = 100000;
+
+    // addresses which are a counter at the start or the end
+    for (uint32_t offset = 0; offset < 32; offset += 28)
+    {
+        memset(buckets, 0, sizeof(buckets));
+
+        for (uint32_t i = 0; i < keys; i++)
+        {
+            memset(address, 0, 32);
+            memcpy(address + offset, &i, sizeof(i));
+            buckets[address_hash(address) % BUCKETS]++;
+        }
+
+        check_buckets(buckets, keys);
+    }
+
+    // numbered strings of all lengths
+    memset(buckets, 0, sizeof(buckets));
+
+    for (uint32_t i = 0; i < keys; i++)
+    {
+        v->len = sprintf((char *)v->data, "key%u", i) + i % 40;
+        memset(v->data + strlen((char *)v->data), 'x', i % 40);
+        buckets[vector_hash(v) % BUCKETS]++;
+    }
+
+    check_buckets(buckets, keys);
+
+    // the hash must not depend on the alignment of the data
+    v->len = 20;
+    memcpy(v->data, "abcdefghijklmnopqrstu", 21);
+    uint64_t hash = vector_hash(v);
+    struct vector *unaligned = (struct vector *)((uint8_t *)malloc(sizeof(struct vector) + 64) + 1);
+    unaligned->len = 20;
+    memcpy(unaligned->data, "abcdefghijklmnopqrstu", 21);
+    assert(vector_hash(unaligned) == hash);
+
+    // trailing zero bytes change the hash
+    v->len = 3;
+    memset(v->data, 0, 4);
+    hash = vector_hash(v);
+    v->len = 4;
+    assert(vector_hash(v) != hash);
+
+    // throughput
+    uint64_t sum = 0;
+    v->len = 64;
+    clock_t start = clock();
+
+    for (uint32_t i = 0; i < 10000000; i++)
+    {
+        address[0] = i;
+        v->data[0] = i;
+        sum += address_hash(address) + vector_hash(v);
+    }
+
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("hashed 10000000 addresses and 64 byte strings in %.2fs (%lx)\n", seconds, (unsigned long)sum);
+}
+
+// Check the account index finds the same account as a linear scan
+void test_ka_index()
+{
+    SolParameters params;
+    SolAccountInfo ka[40];
+    SolPubkey keys[SOL_ARRAY_SIZE(ka)], other;
+
+    params.ka = ka;
+
+    for (int round = 0; round < 10000; round++)
+    {
+        params.ka_num = rand() % (SOL_ARRAY_SIZE(ka) + 1);
+
+        for (int i = 0; i < params.ka_num; i++)
+        {
+            for (int x = 0; x < sizeof(SolPubkey); x++)
+                keys[i].x[x] = rand() % 4 ? instructions_address.x[x] : rand();
+
+            // duplicate accounts share the key with an earlier account
+            params.ka[i].key = i && rand() % 4 == 0 ? params.ka[rand() % i].key : &keys[i];
+        }
+
+        ka_index_build(&params);
+
+        for (int i = 0; i < params.ka_num; i++)
+        {
+            int expected = 0;
+
+            while (!SolPubkey_same(params.ka[expected].key, params.ka[i].key))
+                expected++;
+
+            memcpy(&other, params.ka[i].key, sizeof(other));
+            assert(ka_index_lookup(&other, &params) == expected);
+        }
+
+        memcpy(&other, &clock_address, sizeof(other));
+        assert(ka_index_lookup(&other, &params) == -1);
+
+        free(params.ka_index);
+    }
+}
+
+// Check the cached metas have the callee first and the other accounts in order, like a fresh list
+void test_cpi_metas()
+{
+    SolParameters params;
+    SolAccountInfo ka[40];
+    SolPubkey keys[SOL_ARRAY_SIZE(ka)];
+
+    params.ka = ka;
+
+    for (int round = 0; round < 1000; round++)
+    {
+        params.ka_num = rand() % SOL_ARRAY_SIZE(ka) + 1;
+        params.metas = NULL;
+
+        for (int i = 0; i < params.ka_num; i++)
+        {
+            ka[i].key = &keys[i];
+            ka[i].is_writable = rand() % 2;
+            ka[i].is_signer = rand() % 2;
+        }
+
+        for (int call = 0, callee = 0; call < 20; call++)
+        {
+            // calling the same account again leaves the metas as they are
+            if (rand() % 3)
+                callee = rand() % params.ka_num;
+
+            SolAccountMeta *metas = cpi_metas(&params, callee);
+
+            for (int meta_no = 0; meta_no < params.ka_num; meta_no++)
+            {
+                int account_no = meta_no == 0 ? callee : meta_no <= callee ? meta_no - 1 : meta_no;
+
+                assert(metas[meta_no].pubkey == ka[account_no].key);
+                assert(metas[meta_no].is_writable == ka[account_no].is_writable);
+                assert(metas[meta_no].is_signer == ka[account_no].is_signer);
+            }
+        }
+
+        free(params.metas);
+    }
+}
+
+// Add an ed25519 instruction to the instructions sysvar, with signatures for the given public keys.
+// The signature and message are derived from the key. The signature numbered other refers to the
+// message of another instruction, so it must not verify.
+static uint8_t *add_ed25519_instruction(uint8_t *p, uint16_t instr_no, int sigs, const uint8_t keys[][32],
+                                        uint16_t other)
+{
+    // one account
+    *(uint16_t *)p = 1;
+    p += 2 + 33;
+    memcpy(p, &ed25519_address, 32);
+    p += 32;
+
+    uint8_t *data = p + 2;
+    struct ed25519_instruction *ed25519 = (struct ed25519_instruction *)data;
+    uint8_t *payload = (uint8_t *)&ed25519->sig[sigs];
+
+    ed25519->num_signatures = sigs;
+
+    for (int i = 0; i < sigs; i++)
+    {
+        struct ed25519_instruction_sig *sig = &ed25519->sig[i];
+
+        // an odd offset, like a real transaction might have
+        payload += 1;
+        memcpy(payload, keys[i], 32);
+        sig->public_key_offset = payload - data;
+        payload += 32;
+        for (int x = 0; x < 64; x++)
+            payload[x] = keys[i][0] + x;
+        sig->signature_offset = payload - data;
+        payload += 64;
+        memcpy(payload, "message", 7);
+        payload[7] = keys[i][1];
+        sig->message_offset = payload - data;
+        sig->message_size = 8;
+        payload += 8;
+
+        sig->public_key_instruction_index = instr_no;
+        sig->signature_instruction_index = instr_no;
+        sig->message_instruction_index = i == other ? instr_no + 1 : instr_no;
+    }
+
+    *(uint16_t *)p = payload - data;
+
+    return payload;
+}
+
+static bool verify(const uint8_t key[32], uint8_t message_byte, SolParameters *params)
+{
+    struct vector *message = malloc(sizeof(struct vector) + 8);
+    struct vector *signature = malloc(sizeof(struct vector) + 64);
+    uint8_t public_key[32];
+
+    memcpy(public_key, key, 32);
+    message->len = 8;
+    memcpy(message->data, "message", 7);
+    message->data[7] = message_byte;
+    signature->len = 64;
+    for (int x = 0; x < 64; x++)
+        signature->data[x] = key[0] + x;
+
+    uint8_t *public_keys[1] = {public_key};
+    uint64_t ret = signature_verify(public_key, message, signature, params);
+
+    assert(signature_verify_batch(1, public_keys, &message, &signature, params) == ret);
+
+    free(message);
+    free(signature);
+
+    return ret == 0;
+}
+
+void test_signature_verify()
+{
+    static uint8_t sysvar[8192];
+    uint8_t keys[40][32];
+    SolAccountInfo instructions = {.data = sysvar};
+    SolParameters params = {.ka_instructions = &instructions, .ed25519_index = NULL};
+
+    for (int i = 0; i < 40; i++)
+        for (int x = 0; x < 32; x++)
+            keys[i][x] = rand();
+
+    // the same key twice, with different messages
+    memcpy(keys[33], keys[30], 32);
+    keys[33][1] = keys[30][1] + 1;
+
+    uint16_t *offsets = (uint16_t *)sysvar;
+    uint8_t *p = sysvar + 2 + 3 * 2;
+
+    offsets[0] = 3;
+
+    // not an ed25519 instruction
+    offsets[1] = p - sysvar;
+    *(uint16_t *)p = 0;
+    memset(p + 2, 1, 32);
+    *(uint16_t *)(p + 34) = 0;
+    p += 36;
+
+    offsets[2] = p - sysvar;
+    p = add_ed25519_instruction(p, 1, 20, keys, UINT16_MAX);
+    offsets[3] = p - sysvar;
+    p = add_ed25519_instruction(p, 2, 15, keys + 20, 5);
+
+    assert(p < sysvar + sizeof(sysvar));
+
+    for (int i = 0; i < 35; i++)
+    {
+        uint8_t message_byte = i == 33 ? keys[30][1] + 1 : keys[i][1];
+
+        assert(verify(keys[i], message_byte, &params) == (i != 25));
+        assert(!verify(keys[i], message_byte + 1, &params) || i == 30);
+    }
+
+    for (int i = 35; i < 40; i++)
+        assert(!verify(keys[i], keys[i][1], &params));
+
+    // no instructions sysvar
+    params.ka_instructions = NULL;
+    params.ed25519_index = NULL;
+    assert(!verify(keys[0], keys[0][1], &params));
+}
+
+void *__malloc(uint32_t size)
+{
+    return malloc(size);
+}
+
 int main()
 {
-    uint8_t data[0x10000];
+    test_memory_kernels();
+    test_byte_order();
+    test_hashes();
+    test_ka_index();
+    test_cpi_metas();
+    test_signature_verify();
+
+    // laid out like the serialized input, so the account can grow
+    static uint64_t input[(0x10000 + 88 + MAX_PERMITTED_DATA_INCREASE) / 8];
+    uint8_t *data = (uint8_t *)input + 88;
     SolAccountInfo ai;
+    uint64_t lamports = rent_exempt_minimum(0x10000);
+    ai.key = (SolPubkey *)(data - 80);
     ai.data = data;
-    ai.data_len = sizeof(data);
+    ai.data_len = 0x100;
+    ai.is_writable = true;
+    ai.lamports = &lamports;
+    ((uint32_t *)ai.key)[-1] = ai.data_len;
+    ((uint64_t *)data)[-1] = ai.data_len;
+
+    // the account only grows if it stays rent exempt
+    lamports = rent_exempt_minimum(0x100);
+    assert(account_data_reserve(&ai, 0xff) && !account_data_reserve(&ai, 0x100));
+    assert(ai.data_len == 0x100);
+    lamports = rent_exempt_minimum(0x10000);
+
     uint32_t offs[100], lens[100];
     uint32_t allocs = 0;
 
-    memset(data, 0, sizeof(data));
-    struct account_data_header *hdr = data;
+    struct account_data_header *hdr = (struct account_data_header *)data;
     hdr->magic = 0x41424344;
     hdr->heap_offset = 0x20;
 
     memset(offs, 0, sizeof(offs));
 
+    // Fragmentation is measured over a fixed sequence of steps, so the result is the same on
+    // every run. After that, the test continues with a random seed until it times out.
     int seed = time(NULL);
     printf("seed: %d\n", seed);
-    srand(seed);
+    srand(FRAGMENTATION_SEED);
 
     uint32_t new_offset;
-    uint64_t status;
+    uint64_t status, fragmentation = 0, steps = 0;
 
     for (;;)
     {
         validate_heap(data, offs, lens);
 
+        struct heap_stats stats;
+        uint32_t live_allocations = 0, live_bytes = 0;
+
+        for (int i = 0; i < 100; i++)
+        {
+            if (offs[i])
+            {
+                live_allocations++;
+                live_bytes += lens[i];
+            }
+        }
+
+        assert(account_data_stats(&ai, &stats));
+        assert(stats.live_allocations == live_allocations && stats.live_bytes == live_bytes);
+        assert(stats.high_water <= ai.data_len && stats.largest_free < stats.high_water);
+
         int n = rand() % 100;
         if (offs[n] == 0)
         {
@@ -814,6 +1675,34 @@ int main()
             lens[n] = size;
         }
 
+        assert(ai.data_len == ((uint64_t *)data)[-1] && ai.data_len <= 0x10000);
+
+        if (rand() % 10 == 0)
+        {
+            // as if this was the next instruction
+            ((uint32_t *)ai.key)[-1] = ai.data_len;
+        }
+
+        if (rand() % 1000 == 0)
+        {
+            // as if the account was written by an older version
+            hdr->heap_last = 0;
+            hdr->heap_free = 0;
+        }
+
+        if (steps < FRAGMENTATION_STEPS)
+        {
+            fragmentation += heap_fragmentation(data);
+
+            if (++steps == FRAGMENTATION_STEPS)
+            {
+                printf("average fragmentation %lu/1000\n", (unsigned long)(fragmentation / steps));
+                assert(fragmentation / steps < BEST_FIT_FRAGMENTATION);
+
+                srand(seed);
+            }
+        }
+
         if (time(NULL) - seed > 120)
         {
             printf("No error found after running for two minutes\n");
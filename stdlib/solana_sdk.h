@@ -117,15 +117,19 @@ typedef struct
     bool executable;     /** This account's data contains a loaded program (and is now read-only) */
 } SolAccountInfo;
 
+/**
+ * Memory syscalls
+ */
+void sol_memcpy_(void *dst, const void *src, uint64_t n);
+void sol_memcmp_(const void *s1, const void *s2, uint64_t n, int *result);
+void sol_memset_(void *s, uint8_t c, uint64_t n);
+
 /**
  * Copies memory
  */
 static void sol_memcpy(void *dst, const void *src, int len)
 {
-    for (int i = 0; i < len; i++)
-    {
-        *((uint8_t *)dst + i) = *((const uint8_t *)src + i);
-    }
+    sol_memcpy_(dst, src, len);
 }
 
 /**
@@ -133,15 +137,9 @@ static void sol_memcpy(void *dst, const void *src, int len)
  */
 static int sol_memcmp(const void *s1, const void *s2, int n)
 {
-    for (int i = 0; i < n; i++)
-    {
-        uint8_t diff = *((uint8_t *)s1 + i) - *((const uint8_t *)s2 + i);
-        if (diff)
-        {
-            return diff;
-        }
-    }
-    return 0;
+    int result;
+    sol_memcmp_(s1, s2, n, &result);
+    return result;
 }
 
 /**
@@ -149,13 +147,7 @@ static int sol_memcmp(const void *s1, const void *s2, int n)
  */
 static void sol_memset(void *b, int c, size_t len)
 {
-    uint8_t *a = (uint8_t *)b;
-    while (len > 0)
-    {
-        *a = c;
-        a++;
-        len--;
-    }
+    sol_memset_(b, c, len);
 }
 
 /**
@@ -204,12 +196,22 @@ typedef struct
     uint64_t len;        /** Length of the seed bytes */
 } SolSignerSeed;
 
+/**
+ * Account Meta
+ */
+typedef struct
+{
+    SolPubkey *pubkey; /** An account's public key */
+    bool is_writable;  /** True if the `pubkey` can be loaded as a read-write account */
+    bool is_signer;    /** True if an Instruction requires a Transaction signature matching `pubkey` */
+} SolAccountMeta;
+
 /**
  * Structure that the program's entrypoint input data is deserialized into.
  */
 typedef struct
 {
-    SolAccountInfo ka[10]; /** Pointer to an array of SolAccountInfo, must already
+    SolAccountInfo *ka;    /** Pointer to an array of SolAccountInfo, must already
                           point to an array of SolAccountInfos */
     uint64_t ka_num;       /** Number of SolAccountInfo entries in `ka` */
     const uint8_t *input;  /** pointer to the instruction data */
@@ -217,6 +219,11 @@ typedef struct
     SolPubkey *program_id; /** program_id of the currently executing program */
     const SolAccountInfo *ka_clock;
     const SolAccountInfo *ka_instructions;
+    uint16_t *ka_index;     /** Open addressing hash index over the keys in `ka`, of account number + 1 */
+    uint32_t ka_index_mask; /** Number of slots in `ka_index` minus one */
+    struct ed25519_index *ed25519_index;
+    SolAccountMeta *metas; /** Account metas for cross program invocations, built on first use */
+    uint64_t metas_first;  /** Account number of the account which is first in `metas` */
 } SolParameters;
 
 /**
@@ -224,6 +231,22 @@ typedef struct
  */
 #define MAX_PERMITTED_DATA_INCREASE (1024 * 10)
 
+/**
+ * Maximum length of the data of an account
+ */
+#define MAX_PERMITTED_DATA_LENGTH (10 * 1024 * 1024)
+
+/**
+ * Default rent in lamports per byte-year, and the number of years of rent an account must hold to be rent exempt
+ */
+#define DEFAULT_LAMPORTS_PER_BYTE_YEAR 3480
+#define DEFAULT_EXEMPTION_THRESHOLD 2
+
+/**
+ * Number of bytes an account with no data is charged rent for
+ */
+#define ACCOUNT_STORAGE_OVERHEAD 128
+
 /**
  * De-serializes the input parameters into usable types
  *
@@ -236,16 +259,17 @@ typedef struct
  *
  * @param input Source buffer containing serialized input parameters
  * @param params Pointer to a SolParameters structure
+ * @param ka_num Number of SolAccountInfo entries in the array `params->ka` points to
  * @return Boolean true if successful.
  */
-static uint64_t sol_deserialize(const uint8_t *input, SolParameters *params)
+static uint64_t sol_deserialize(const uint8_t *input, SolParameters *params, uint64_t ka_num)
 {
     if (NULL == input || NULL == params)
     {
         return ERROR_INVALID_ARGUMENT;
     }
 
-    uint64_t max_accounts = SOL_ARRAY_SIZE(params->ka);
+    uint64_t max_accounts = ka_num;
     params->ka_num = *(uint64_t *)input;
     input += sizeof(uint64_t);
 
@@ -292,7 +316,10 @@ static uint64_t sol_deserialize(const uint8_t *input, SolParameters *params)
             params->ka[i].executable = *(uint8_t *)input;
             input += sizeof(uint8_t);
 
-            input += 4; // padding
+            // The runtime leaves this padding to the program. Keep the length the account data
+            // had on entry here, so we know how much further it may grow in this instruction.
+            uint32_t *original_data_len = (uint32_t *)input;
+            input += 4;
 
             // key
             params->ka[i].key = (SolPubkey *)input;
@@ -308,6 +335,7 @@ static uint64_t sol_deserialize(const uint8_t *input, SolParameters *params)
 
             // account data
             params->ka[i].data_len = *(uint64_t *)input;
+            *original_data_len = params->ka[i].data_len;
             input += sizeof(uint64_t);
             params->ka[i].data = (uint8_t *)input;
             input += params->ka[i].data_len;
@@ -372,16 +400,6 @@ typedef struct
  */
 static uint64_t sol_sha256(const SolBytes *bytes, int bytes_len, const uint8_t *result);
 
-/**
- * Account Meta
- */
-typedef struct
-{
-    SolPubkey *pubkey; /** An account's public key */
-    bool is_writable;  /** True if the `pubkey` can be loaded as a read-write account */
-    bool is_signer;    /** True if an Instruction requires a Transaction signature matching `pubkey` */
-} SolAccountMeta;
-
 /**
  * Instruction
  */
@@ -536,6 +554,37 @@ void sol_log_64(uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint
 {
     printf("sol_log_64: %llu, %llu, %llu, %llu, %llu\n", arg1, arg2, arg3, arg4, arg5);
 }
+
+/**
+ * Stub memory syscalls when building tests
+ */
+void sol_memcpy_(void *dst, const void *src, uint64_t n)
+{
+    for (uint64_t i = 0; i < n; i++)
+    {
+        *((uint8_t *)dst + i) = *((const uint8_t *)src + i);
+    }
+}
+void sol_memcmp_(const void *s1, const void *s2, uint64_t n, int *result)
+{
+    *result = 0;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        int diff = (int)*((const uint8_t *)s1 + i) - (int)*((const uint8_t *)s2 + i);
+        if (diff)
+        {
+            *result = diff;
+            return;
+        }
+    }
+}
+void sol_memset_(void *s, uint8_t c, uint64_t n)
+{
+    for (uint64_t i = 0; i < n; i++)
+    {
+        *((uint8_t *)s + i) = c;
+    }
+}
 #endif
 
 #ifdef __cplusplus
@@ -5,22 +5,101 @@
 #include <stdbool.h>
 
 #include "stdlib.h"
+#include "profile.h"
 
-/*
- */
-void __memset8(void *_dest, uint64_t val, uint32_t length)
+#if !defined(__wasm__) && !defined(TEST)
+#include "solana_sdk.h"
+
+// Above this length, the memory syscalls are cheaper than a loop
+#define MEM_SYSCALL_THRESHOLD 64
+#endif
+
+// The bulk memory build for Wasm (-mbulk-memory) copies and fills with the memory.copy and
+// memory.fill instructions, which llvm generates for these builtins
+#ifdef __wasm_bulk_memory__
+#define BULK_MEMORY
+#endif
+
+// Would dest and src both be aligned after skipping the same number of bytes
+static inline bool same_alignment(const void *dest, const void *src)
 {
-    uint64_t *dest = _dest;
+    return (((uintptr_t)dest ^ (uintptr_t)src) & 7) == 0;
+}
 
-    do
+// Copy memory 8 bytes at a time if the pointers are equally aligned, else one byte at a time.
+// This is also correct for overlapping memory if dest is below src.
+static inline void copy_bytes(uint8_t *dest, const uint8_t *src, uint32_t length)
+{
+    if (length >= 16 && same_alignment(dest, src))
+    {
+        while ((uintptr_t)dest & 7)
+        {
+            *dest++ = *src++;
+            length--;
+        }
+
+        word *d = (word *)dest;
+        const word *s = (const word *)src;
+
+        for (; length >= 8; length -= 8)
+            *d++ = *s++;
+
+        dest = (uint8_t *)d;
+        src = (const uint8_t *)s;
+    }
+
+    while (length--)
+        *dest++ = *src++;
+}
+
+static inline void set_bytes(uint8_t *dest, uint8_t val, size_t length)
+{
+    if (length >= 16)
     {
+        while ((uintptr_t)dest & 7)
+        {
+            *dest++ = val;
+            length--;
+        }
+
+        word *d = (word *)dest;
+        word w = val * 0x0101010101010101ULL;
+
+        for (; length >= 8; length -= 8)
+            *d++ = w;
+
+        dest = (uint8_t *)d;
+    }
+
+    while (length--)
         *dest++ = val;
-    } while (--length);
 }
 
-void __memset(void *_dest, uint8_t val, size_t length)
+// Return the offset of the first eight byte word which differs, where it starts at the same
+// alignment in both. The bytes before the offset are equal.
+static inline uint32_t skip_equal_words(const uint8_t *a, const uint8_t *b, uint32_t length)
+{
+    uint32_t offset = 0;
+
+    if (length >= 16 && same_alignment(a, b))
+    {
+        while ((uintptr_t)(a + offset) & 7)
+        {
+            if (a[offset] != b[offset])
+                return offset;
+            offset++;
+        }
+
+        while (offset + 8 <= length && *(const word *)(a + offset) == *(const word *)(b + offset))
+            offset += 8;
+    }
+
+    return offset;
+}
+
+void __memset8(void *_dest, uint64_t val, uint32_t length)
 {
-    uint8_t *dest = _dest;
+    word *dest = _dest;
 
     do
     {
@@ -28,14 +107,39 @@ void __memset(void *_dest, uint8_t val, size_t length)
     } while (--length);
 }
 
+void __memset(void *dest, uint8_t val, size_t length)
+{
+    PROFILE(PROFILE_MEMSET, length);
+
+#ifdef BULK_MEMORY
+    __builtin_memset(dest, val, length);
+    return;
+#endif
+
+#ifdef MEM_SYSCALL_THRESHOLD
+    if (length > MEM_SYSCALL_THRESHOLD)
+    {
+        sol_memset_(dest, val, length);
+        return;
+    }
+#endif
+
+    set_bytes(dest, val, length);
+}
+
 /*
  * Our memcpy can only deal with multiples of 8 bytes. This is enough for
  * simple allocator below.
  */
 void __memcpy8(void *_dest, void *_src, uint32_t length)
 {
-    uint64_t *dest = _dest;
-    uint64_t *src = _src;
+#ifdef BULK_MEMORY
+    __builtin_memmove(_dest, _src, length * 8);
+    return;
+#endif
+
+    word *dest = _dest;
+    word *src = _src;
 
     do
     {
@@ -43,15 +147,26 @@ void __memcpy8(void *_dest, void *_src, uint32_t length)
     } while (--length);
 }
 
-void __memcpy(void *_dest, const void *_src, uint32_t length)
+void __memcpy(void *dest, const void *src, uint32_t length)
 {
-    uint8_t *dest = _dest;
-    const uint8_t *src = _src;
+    PROFILE(PROFILE_MEMCPY, length);
 
-    while (length--)
+#ifdef BULK_MEMORY
+    // memory.copy allows overlapping memory, like copy_bytes()
+    __builtin_memmove(dest, src, length);
+    return;
+#endif
+
+#ifdef MEM_SYSCALL_THRESHOLD
+    // the syscall fails if the memory overlaps
+    if (length > MEM_SYSCALL_THRESHOLD && (dest + length <= src || src + length <= dest))
     {
-        *dest++ = *src++;
+        sol_memcpy_(dest, src, length);
+        return;
     }
+#endif
+
+    copy_bytes(dest, src, length);
 }
 
 /*
@@ -59,7 +174,20 @@ void __memcpy(void *_dest, const void *_src, uint32_t length)
  */
 void __bzero8(void *_dest, uint32_t length)
 {
-    uint64_t *dest = _dest;
+#ifdef BULK_MEMORY
+    __builtin_memset(_dest, 0, length * 8);
+    return;
+#endif
+
+#ifdef MEM_SYSCALL_THRESHOLD
+    if (length > MEM_SYSCALL_THRESHOLD / 8)
+    {
+        sol_memset_(_dest, 0, length * 8);
+        return;
+    }
+#endif
+
+    word *dest = _dest;
 
     while (length--)
     {
@@ -69,74 +197,104 @@ void __bzero8(void *_dest, uint32_t length)
 
 int __memcmp_ord(uint8_t *a, uint8_t *b, uint32_t len)
 {
-    do
+    for (uint32_t i = skip_equal_words(a, b, len); i < len; i++)
     {
-        int diff = (int)(*a++) - (int)(*b++);
+        int diff = (int)a[i] - (int)b[i];
 
         if (diff)
             return diff;
-    } while (--len);
+    }
 
     return 0;
 }
 
+// Copy length bytes which end at from_end to to, in reverse order. If the words of to line up
+// with words of from, eight bytes at a time are reversed with a byte swap, which is a single
+// instruction on SBF. The common widths of 8, 16 and 32 bytes are then a few swaps. The source
+// and the destination must not overlap.
+static inline void reverse_bytes(uint8_t *to, const uint8_t *from_end, uint32_t length)
+{
+    if (length >= 8 && (((uintptr_t)to + (uintptr_t)from_end) & 7) == 0)
+    {
+        while ((uintptr_t)to & 7)
+        {
+            *to++ = *--from_end;
+            length--;
+        }
+
+        word *d = (word *)to;
+        const word *s = (const word *)from_end;
+
+        for (; length >= 8; length -= 8)
+            *d++ = __builtin_bswap64(*--s);
+
+        to = (uint8_t *)d;
+        from_end = (const uint8_t *)s;
+    }
+
+    while (length--)
+        *to++ = *--from_end;
+}
+
 // This function is used for abi decoding integers.
 // ABI encoding is big endian, and can have integers of 8 to 256 bits
 // (1 to 32 bytes). This function copies length bytes and reverses the
 // order since wasm is little endian.
 void __be32toleN(uint8_t *from, uint8_t *to, uint32_t length)
 {
-    from += 31;
-
-    do
-    {
-        *to++ = *from--;
-    } while (--length);
+    reverse_bytes(to, from + 32, length);
 }
 
 void __beNtoleN(uint8_t *from, uint8_t *to, uint32_t length)
 {
-    from += length;
-
-    do
-    {
-        *to++ = *--from;
-    } while (--length);
+    reverse_bytes(to, from + length, length);
 }
 
 // This function is for used for abi encoding integers
 // ABI encoding is big endian.
 void __leNtobe32(uint8_t *from, uint8_t *to, uint32_t length)
 {
-    to += 31;
-
-    do
-    {
-        *to-- = *from++;
-    } while (--length);
+    reverse_bytes(to + 32 - length, from + length, length);
 }
 
 void __leNtobeN(uint8_t *from, uint8_t *to, uint32_t length)
 {
-    to += length;
-    do
-    {
-        *--to = *from++;
-    } while (--length);
+    reverse_bytes(to, from + length, length);
+}
+
+// Read a little endian lane one byte at a time, for unaligned data or the tail of it
+static inline uint64_t load_lane(const uint8_t *data, uint32_t len)
+{
+    uint64_t lane = 0;
+
+    for (uint32_t i = 0; i < len; i++)
+        lane |= (uint64_t)data[i] << (i * 8);
+
+    return lane;
 }
 
 uint64_t vector_hash(struct vector *v)
 {
-    uint64_t hash = 0;
-    uint8_t *data = v->data;
+    const uint8_t *data = v->data;
     uint32_t len = v->len;
+    // start with the length, so that trailing zero bytes change the hash
+    uint64_t hash = len;
 
-    while (len--)
+    if (((uintptr_t)data & 7) == 0)
     {
-        hash += *data;
+        for (; len >= 8; len -= 8, data += 8)
+            hash = hash_lane(hash, *(const word *)data);
     }
+    else
+    {
+        for (; len >= 8; len -= 8, data += 8)
+            hash = hash_lane(hash, load_lane(data, 8));
+    }
+
+    if (len)
+        hash = hash_lane(hash, load_lane(data, len));
 
-    return hash;
+    return hash_finish(hash);
 }
 
 bool __memcmp(uint8_t *left, uint32_t left_len, uint8_t *right, uint32_t right_len)
@@ -144,9 +302,20 @@ bool __memcmp(uint8_t *left, uint32_t left_len, uint8_t *right, uint32_t right_l
     if (left_len != right_len)
         return false;
 
-    while (left_len--)
+#ifdef MEM_SYSCALL_THRESHOLD
+    if (left_len > MEM_SYSCALL_THRESHOLD)
     {
-        if (*left++ != *right++)
+        int result;
+
+        sol_memcmp_(left, right, left_len, &result);
+
+        return result == 0;
+    }
+#endif
+
+    for (uint32_t i = skip_equal_words(left, right, left_len); i < left_len; i++)
+    {
+        if (left[i] != right[i])
             return false;
     }
 
@@ -171,22 +340,10 @@ struct vector *vector_new(uint32_t members, uint32_t size, uint8_t *initial)
     v->len = members;
     v->size = members;
 
-    uint8_t *data = v->data;
-
     if (initial != VECTOR_EMPTY)
-    {
-        while (size_array--)
-        {
-            *data++ = *initial++;
-        }
-    }
+        __memcpy(v->data, initial, size_array);
     else
-    {
-        while (size_array--)
-        {
-            *data++ = 0;
-        }
-    }
+        __memset(v->data, 0, size_array);
 
     return v;
 }
@@ -198,19 +355,134 @@ struct vector *concat(uint8_t *left, uint32_t left_len, uint8_t *right, uint32_t
     v->len = size_array;
     v->size = size_array;
 
-    uint8_t *data = v->data;
+    __memcpy(v->data, left, left_len);
+    __memcpy(v->data + left_len, right, right_len);
+
+    return v;
+}
+
+/*
+ * Vector builder. The size field of a vector is its capacity in members, which may be more than
+ * its length. vector_reserve() allocates an empty vector for the given number of bytes, and
+ * vector_append() copies bytes onto the end, growing the vector if needed. When the total
+ * length is known up front, as in a chain of string concatenations, there is only one
+ * allocation.
+ */
+struct vector *vector_reserve(uint32_t size)
+{
+    struct vector *v = __malloc(sizeof(*v) + size);
+    v->len = 0;
+    v->size = size;
+
+    return v;
+}
+
+// Grow the vector so that it has room for at least members, doubling its capacity so that
+// appending in a loop only reallocates now and then
+static struct vector *vector_grow(struct vector *v, uint32_t members, uint32_t elem_size)
+{
+    uint32_t size = v->size * 2;
+
+    if (size < members)
+        size = members;
+    if (size < 4)
+        size = 4;
+
+    v = __realloc(v, sizeof(*v) + size * elem_size);
+    v->size = size;
+
+    return v;
+}
+
+struct vector *vector_append(struct vector *v, uint8_t *data, uint32_t length)
+{
+    if (v->len + length > v->size)
+        v = vector_grow(v, v->len + length, 1);
+
+    __memcpy(v->data + v->len, data, length);
+    v->len += length;
+
+    return v;
+}
+
+// Add a member to the end of the vector, without setting its value. The vector may move.
+struct vector *vector_push(struct vector *v, uint32_t elem_size)
+{
+    if (v->len == v->size)
+        v = vector_grow(v, v->len + 1, elem_size);
+
+    v->len++;
+
+    return v;
+}
+
+#if defined(STDLIB_PROFILE) && defined(__wasm__)
+struct profile_counter __profile_counters[PROFILE_HELPERS];
+
+extern uint32_t debug_message(const char *message, uint32_t length);
+extern char *uint2dec(char *output, uint64_t val);
 
-    while (left_len--)
+// The log is not written with __memcpy, which would count itself
+static char *profile_text(char *p, const char *text)
+{
+    while (*text)
+        *p++ = *text++;
+
+    return p;
+}
+
+static char *profile_values(char *p, const uint64_t values[], int count)
+{
+    for (int i = 0; i < count; i++)
     {
-        *data++ = *left++;
+        if (i)
+        {
+            *p++ = ',';
+            *p++ = ' ';
+        }
+
+        p = uint2dec(p, values[i]);
     }
 
-    while (right_len--)
+    *p++ = '\n';
+
+    return p;
+}
+
+// Wasm contracts have no entrypoint in the stdlib, so codegen calls this before the contract
+// returns. Like the Solana entrypoint, it writes the number of calls, the amount and the loop
+// iterations for each helper which was called, and the usage of the heap, to the debug buffer.
+void __profile_log()
+{
+    static const char helpers[] = "stdlib profile: helper, calls, amount, iterations\n";
+    static const char heap[] = "heap: high water, allocations, bytes, free chunks, largest free\n";
+    // each value is at most 20 digits and a separator
+    char buf[sizeof(helpers) + sizeof(heap) + (PROFILE_HELPERS * 4 + 5) * 22];
+    char *p = profile_text(buf, helpers);
+    struct heap_stats stats;
+
+    for (uint64_t helper = 0; helper < PROFILE_HELPERS; helper++)
     {
-        *data++ = *right++;
+        struct profile_counter *counter = &__profile_counters[helper];
+
+        if (counter->calls)
+        {
+            uint64_t values[4] = {helper, counter->calls, counter->amount, counter->iterations};
+
+            p = profile_values(p, values, 4);
+        }
     }
 
-    return v;
+    __heap_stats(&stats);
+
+    uint64_t values[5] = {stats.high_water, stats.live_allocations, stats.live_bytes, stats.free_chunks,
+                          stats.largest_free};
+
+    p = profile_text(p, heap);
+    p = profile_values(p, values, 5);
+
+    debug_message(buf, p - buf);
 }
+#endif
 
 #endif
\ No newline at end of file
@@ -10,7 +10,47 @@ struct vector
     uint8_t data[];
 };
 
+// For loads and stores of 8 bytes at a time. Any type of memory may be accessed through it.
+typedef uint64_t __attribute__((may_alias)) word;
+
+/*
+ * Hashing for mapping buckets. Each 64 bit little endian lane of the key is mixed in
+ * like FxHash, and the result is finalized like MurmurHash3 so that all bits of the
+ * hash depend on all bits of the key.
+ */
+static inline uint64_t hash_lane(uint64_t hash, uint64_t lane)
+{
+    return (((hash << 5) | (hash >> 59)) ^ lane) * 0x517cc1b727220a95ULL;
+}
+
+static inline uint64_t hash_finish(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
 extern void *__malloc(uint32_t size);
+extern void *__realloc(void *m, uint32_t size);
+extern void __free(void *m);
 extern void __memset(void *dest, uint8_t val, size_t length);
 extern void __memcpy(void *dest, const void *src, uint32_t length);
 extern void __memcpy8(void *_dest, void *_src, uint32_t length);
+
+/*
+ * Usage of a heap, for sizing the heap frame and the account data. The high water mark is the
+ * highest offset from the start of the heap which has ever been handed out; for the account
+ * data heap, it is how much of the account data is in use.
+ */
+struct heap_stats
+{
+    uint32_t high_water;
+    uint32_t live_allocations;
+    uint32_t live_bytes;
+    uint32_t free_chunks;
+    uint32_t largest_free;
+};
+
+extern void __heap_stats(struct heap_stats *stats);
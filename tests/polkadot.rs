@@ -11,7 +11,7 @@ use std::collections::HashSet;
 use std::{collections::HashMap, ffi::OsStr, fmt, fmt::Write};
 use tiny_keccak::{Hasher, Keccak};
 use wasmi::core::{HostError, Trap, TrapCode};
-use wasmi::{Engine, Error, Instance, Linker, Memory, MemoryType, Module, Store};
+use wasmi::{Config, Engine, Error, Instance, Linker, Memory, MemoryType, Module, Store};
 
 use solang::codegen::Options;
 use solang::file_resolver::FileResolver;
@@ -124,12 +124,16 @@ impl From<WasmCode> for Contract {
 impl Contract {
     /// Instantiate this contract as a Wasm module for execution.
     fn instantiate(&self, runtime: Runtime) -> Result<(Store<Runtime>, Instance), Error> {
-        let engine = Engine::default();
+        // Like the contracts pallet, only accept bulk memory instructions if the chain supports them
+        let mut config = Config::default();
+        config.wasm_bulk_memory(runtime.bulk_memory);
+        let engine = Engine::new(&config);
         let mut store = Store::new(&engine, runtime);
 
         let mut linker = <Linker<Runtime>>::new(&engine);
         Runtime::define(&mut store, &mut linker);
-        let memory = Memory::new(&mut store, MemoryType::new(16, Some(16)).unwrap()).unwrap();
+        // Like the contracts pallet, provide the memory the contract asks for; it grows the rest
+        let memory = Memory::new(&mut store, MemoryType::new(2, Some(16)).unwrap()).unwrap();
         linker.define("env", "memory", memory).unwrap();
         store.data_mut().memory = Some(memory);
 
@@ -229,6 +233,8 @@ struct Runtime {
     events: Vec<Event>,
     /// The set of called events, needed for reentrancy protection.
     called_accounts: HashSet<usize>,
+    /// Whether the chain supports the Wasm bulk memory instructions.
+    bulk_memory: bool,
 }
 
 impl Runtime {
@@ -1036,16 +1042,26 @@ pub fn build_solidity_with_options(src: &str, log_ret: bool, log_err: bool) -> M
     MockSubstrate(Store::new(&Engine::default(), Runtime::new(blobs)))
 }
 
+/// A variant of `MockSubstrate::build_solidity()` which compiles with the given `opts`. The
+/// mock chain supports bulk memory if the contracts are built for it.
+pub fn build_solidity_with_opts(src: &str, opts: &Options) -> MockSubstrate {
+    let blobs = build_wasm_with_opts(src, opts)
+        .iter()
+        .map(|(code, abi)| WasmCode::new(abi, code))
+        .collect();
+    let runtime = Runtime {
+        bulk_memory: opts.wasm_bulk_memory,
+        ..Runtime::new(blobs)
+    };
+
+    MockSubstrate(Store::new(&Engine::default(), runtime))
+}
+
 pub fn build_wasm(src: &str, log_ret: bool, log_err: bool) -> Vec<(Vec<u8>, String)> {
-    let tmp_file = OsStr::new("test.sol");
-    let mut cache = FileResolver::default();
-    cache.set_file_contents(tmp_file.to_str().unwrap(), src.to_string());
     let opt = inkwell::OptimizationLevel::Default;
-    let target = Target::default_polkadot();
-    let (wasm, ns) = compile(
-        tmp_file,
-        &mut cache,
-        target,
+
+    build_wasm_with_opts(
+        src,
         &Options {
             opt_level: opt.into(),
             log_api_return_codes: log_ret,
@@ -1055,6 +1071,19 @@ pub fn build_wasm(src: &str, log_ret: bool, log_err: bool) -> Vec<(Vec<u8>, Stri
             wasm_opt: Some(contract_build::OptimizationPasses::Z),
             ..Default::default()
         },
+    )
+}
+
+fn build_wasm_with_opts(src: &str, opts: &Options) -> Vec<(Vec<u8>, String)> {
+    let tmp_file = OsStr::new("test.sol");
+    let mut cache = FileResolver::default();
+    cache.set_file_contents(tmp_file.to_str().unwrap(), src.to_string());
+    let target = Target::default_polkadot();
+    let (wasm, ns) = compile(
+        tmp_file,
+        &mut cache,
+        target,
+        opts,
         vec!["unknown".to_string()],
         "0.0.1",
     );
@@ -2,8 +2,13 @@
 
 use parity_scale_codec::{Decode, Encode};
 use rand::Rng;
+use solang::codegen::Options;
+use solang::file_resolver::FileResolver;
+use solang::{compile, Target};
+use std::ffi::OsStr;
+use wasmparser::{Operator, Parser, Payload};
 
-use crate::build_solidity;
+use crate::{build_solidity, build_solidity_with_opts};
 
 #[derive(Debug, PartialEq, Eq, Encode, Decode)]
 struct Val32(u32);
@@ -1576,3 +1581,129 @@ fn abi_decode_dynamic_array3() {
 
     runtime.function("decode_empty", vec![]);
 }
+
+#[test]
+fn memory_grows() {
+    let mut runtime = build_solidity(
+        r#"
+        contract Test {
+            function test(uint32 n) public pure returns (uint32) {
+                // far more than the initial memory of the contract
+                bytes b = new bytes(n);
+                bytes c = new bytes(n);
+
+                b[n - 1] = 0x41;
+                c[n - 1] = 0x42;
+
+                return uint32(uint8(b[n - 1])) + uint32(uint8(c[n - 1])) + b.length;
+            }
+        }"#,
+    );
+
+    runtime.function("test", 300_000u32.encode());
+    assert_eq!(runtime.output(), (300_000u32 + 0x41 + 0x42).encode());
+}
+
+#[test]
+fn bulk_memory() {
+    let src = r#"
+        contract Test {
+            bytes s;
+
+            event Topics(bytes indexed a, uint64 indexed b);
+
+            function concat(bytes a) public pure returns (bytes) {
+                return bytes.concat(a, a);
+            }
+
+            function store(bytes a) public {
+                s = a;
+            }
+
+            function load() public view returns (bytes) {
+                return s;
+            }
+
+            function zero(uint32 n) public pure returns (bytes) {
+                return new bytes(n);
+            }
+
+            function topics(bytes a, uint64 b) public {
+                emit Topics(a, b);
+            }
+        }"#;
+
+    let memory_copies = |wasm_bulk_memory| {
+        let mut cache = FileResolver::default();
+
+        cache.set_file_contents("test.sol", src.to_string());
+
+        let (wasm, _) = compile(
+            OsStr::new("test.sol"),
+            &mut cache,
+            Target::default_polkadot(),
+            &Options {
+                wasm_bulk_memory,
+                ..Default::default()
+            },
+            vec!["unknown".to_string()],
+            "0.0.1",
+        );
+
+        let mut copies = 0;
+
+        for payload in Parser::new(0).parse_all(&wasm[0].0) {
+            if let Payload::CodeSectionEntry(body) = payload.unwrap() {
+                for op in body.get_operators_reader().unwrap() {
+                    if matches!(op.unwrap(), Operator::MemoryCopy { .. }) {
+                        copies += 1;
+                    }
+                }
+            }
+        }
+
+        copies
+    };
+
+    assert_eq!(memory_copies(false), 0);
+    assert!(memory_copies(true) > 0);
+
+    // Both builds give the same results. Without bulk memory, the mock chain rejects the
+    // instructions, like the contracts pallet does.
+    let a: Vec<u8> = (0..200).collect();
+
+    let events = [false, true].map(|wasm_bulk_memory| {
+        let mut runtime = build_solidity_with_opts(
+            src,
+            &Options {
+                wasm_bulk_memory,
+                ..Default::default()
+            },
+        );
+
+        runtime.constructor(0, Vec::new());
+
+        runtime.function("concat", a.encode());
+        assert_eq!(runtime.output(), [&a[..], &a[..]].concat().encode());
+
+        // the value is copied from the scratch buffer after it is read from storage
+        runtime.function("store", a.encode());
+        runtime.function("load", Vec::new());
+        assert_eq!(runtime.output(), a.encode());
+
+        runtime.function("zero", 1000u32.encode());
+        assert_eq!(runtime.output(), vec![0u8; 1000].encode());
+
+        // the buffer for the topics is cleared with __bzero8
+        runtime.function("topics", (a.clone(), 7u64).encode());
+
+        runtime
+            .events()
+            .into_iter()
+            .map(|event| (event.data, event.topics))
+            .collect::<Vec<_>>()
+    });
+
+    assert_eq!(events[0].len(), 1);
+    assert_eq!(events[0], events[1]);
+}
@@ -1,6 +1,8 @@
 // SPDX-License-Identifier: Apache-2.0
 
-use crate::build_solidity_with_options;
+use crate::{build_solidity_with_options, build_solidity_with_opts};
+use parity_scale_codec::Encode;
+use solang::codegen::Options;
 
 #[test]
 fn debug_buffer_format() {
@@ -44,3 +46,44 @@ call: seal_debug_message=0,
 "#
     );
 }
+
+#[test]
+fn stdlib_profile() {
+    let mut runtime = build_solidity_with_opts(
+        r#"contract Profile {
+            function test(uint128 n) public pure returns (string) {
+                return "n is {}".format(n);
+            }
+        }"#,
+        &Options {
+            stdlib_profile: true,
+            ..Default::default()
+        },
+    );
+
+    runtime.function("test", 10u128.pow(20).encode());
+    assert_eq!(runtime.output(), "n is 100000000000000000000".encode());
+
+    // the helper, the number of calls, the amount and the loop iterations; formatting in
+    // decimal is helper 5, and 10**20 is 21 digits, which takes one division by 10**19
+    let debug_buffer = runtime.debug_buffer();
+
+    assert!(debug_buffer.starts_with("stdlib profile: helper, calls, amount, iterations\n"));
+    assert!(debug_buffer.contains("\n5, 1, 21, 1\n"));
+    assert!(debug_buffer
+        .contains("\nheap: high water, allocations, bytes, free chunks, largest free\n"));
+
+    // the normal stdlib does not write anything
+    let mut runtime = build_solidity_with_options(
+        r#"contract Profile {
+            function test(uint128 n) public pure returns (string) {
+                return "n is {}".format(n);
+            }
+        }"#,
+        false,
+        false,
+    );
+
+    runtime.function("test", 10u128.pow(20).encode());
+    assert!(!runtime.debug_buffer().contains("stdlib profile"));
+}
@@ -29,7 +29,7 @@ use solang::{
 };
 use std::{
     cell::{RefCell, RefMut},
-    collections::HashMap,
+    collections::{HashMap, HashSet},
     convert::TryInto,
     ffi::OsStr,
     io::Write,
@@ -89,6 +89,7 @@ struct VirtualMachine {
     events: Vec<Vec<Vec<u8>>>,
     return_data: Option<(Account, Vec<u8>)>,
     call_params_check: HashMap<Pubkey, CallParametersCheck>,
+    heap_size: usize,
 }
 
 #[derive(Clone)]
@@ -160,17 +161,19 @@ impl<'a> VirtualMachineBuilder<'a> {
 
         cache.set_file_contents("test.sol", self.src.to_string());
 
+        let opts = self.opts.unwrap_or(Options {
+            opt_level: OptimizationLevel::Default,
+            log_api_return_codes: false,
+            log_runtime_errors: true,
+            log_prints: true,
+            ..Default::default()
+        });
+
         let (res, ns) = compile(
             OsStr::new("test.sol"),
             &mut cache,
             Target::Solana,
-            self.opts.as_ref().unwrap_or(&Options {
-                opt_level: OptimizationLevel::Default,
-                log_api_return_codes: false,
-                log_runtime_errors: true,
-                log_prints: true,
-                ..Default::default()
-            }),
+            &opts,
             vec!["unknown".to_string()],
             "0.0.1",
         );
@@ -249,6 +252,7 @@ impl<'a> VirtualMachineBuilder<'a> {
             events: Vec::new(),
             return_data: None,
             call_params_check: HashMap::new(),
+            heap_size: opts.heap_size as usize,
         }
     }
 }
@@ -378,7 +382,14 @@ fn deserialize_parameters(
 ) {
     for r in refs {
         if let Some(entry) = accounts_data.get_mut(&r.account) {
-            let data = input[r.data_offset..r.data_offset + r.length].to_vec();
+            // the program may have grown the account
+            let length =
+                u64::from_ne_bytes(input[r.data_offset - 8..r.data_offset].try_into().unwrap())
+                    as usize;
+
+            assert!(length <= r.length + MAX_PERMITTED_DATA_INCREASE);
+
+            let data = input[r.data_offset..r.data_offset + length].to_vec();
 
             entry.data = data;
             entry.lamports = u64::from_ne_bytes(
@@ -434,6 +445,7 @@ struct SyscallContext<'a> {
     input_len: usize,
     refs: Rc<RefCell<&'a mut Vec<AccountRef>>>,
     heap: *const u8,
+    heap_size: usize,
     pub remaining: u64,
 }
 
@@ -454,7 +466,7 @@ impl<'a> SyscallContext<'a> {
     pub fn heap_verify(&self) {
         const VERBOSE: bool = false;
 
-        let heap: &[u8] = unsafe { std::slice::from_raw_parts(self.heap, DEFAULT_HEAP_SIZE) };
+        let heap: &[u8] = unsafe { std::slice::from_raw_parts(self.heap, self.heap_size) };
 
         const HEAP_START: u64 = 0x3_0000_0000;
         let mut current_elem = HEAP_START;
@@ -929,6 +941,73 @@ fn sol_log_data(
     }
 }
 
+fn sol_memcpy_(
+    _context: &mut SyscallContext,
+    dst: u64,
+    src: u64,
+    len: u64,
+    _arg4: u64,
+    _arg5: u64,
+    memory_mapping: &mut MemoryMapping,
+    result: &mut ProgramResult,
+) {
+    assert!(
+        dst + len <= src || src + len <= dst,
+        "sol_memcpy_: overlapping copy"
+    );
+
+    let src = question_mark!(translate_slice::<u8>(memory_mapping, src, len), result);
+    let dst = question_mark!(translate_slice_mut::<u8>(memory_mapping, dst, len), result);
+
+    dst.copy_from_slice(src);
+
+    *result = ProgramResult::Ok(0);
+}
+
+fn sol_memset_(
+    _context: &mut SyscallContext,
+    dst: u64,
+    c: u64,
+    len: u64,
+    _arg4: u64,
+    _arg5: u64,
+    memory_mapping: &mut MemoryMapping,
+    result: &mut ProgramResult,
+) {
+    let dst = question_mark!(translate_slice_mut::<u8>(memory_mapping, dst, len), result);
+
+    dst.fill(c as u8);
+
+    *result = ProgramResult::Ok(0);
+}
+
+fn sol_memcmp_(
+    _context: &mut SyscallContext,
+    s1: u64,
+    s2: u64,
+    len: u64,
+    result_addr: u64,
+    _arg5: u64,
+    memory_mapping: &mut MemoryMapping,
+    result: &mut ProgramResult,
+) {
+    let s1 = question_mark!(translate_slice::<u8>(memory_mapping, s1, len), result);
+    let s2 = question_mark!(translate_slice::<u8>(memory_mapping, s2, len), result);
+    let cmp_result = question_mark!(
+        translate_type_inner::<i32>(memory_mapping, AccessType::Store, result_addr),
+        result
+    );
+
+    *cmp_result = s1
+        .iter()
+        .zip(s2)
+        .find(|(a, b)| a != b)
+        .map(|(a, b)| *a as i32 - *b as i32)
+        .unwrap_or(0);
+
+    *result = ProgramResult::Ok(0);
+}
+
 #[derive(Debug, Clone, PartialEq, Eq)]
 pub enum Ed25519SigCheckError {
     InvalidPublicKey,
@@ -957,8 +1036,6 @@ impl From<Ed25519SigCheckError> for u64 {
     }
 }
 
-const DEFAULT_HEAP_SIZE: usize = 32 * 1024;
-
 /// Rust representation of C's SolInstruction
 #[derive(Debug)]
 struct SolInstruction {
@@ -1362,7 +1439,7 @@ impl VirtualMachine {
         println!("running bpf with calldata:{}", hex::encode(calldata));
 
         let (mut parameter_bytes, mut refs) = serialize_parameters(calldata, metas, self);
-        let mut heap = vec![0_u8; DEFAULT_HEAP_SIZE];
+        let mut heap = vec![0_u8; self.heap_size];
 
         let program = &self.stack[0];
 
@@ -1418,6 +1495,18 @@ impl VirtualMachine {
             .register_function(b"sol_log_data", sol_log_data)
             .unwrap();
 
+        loader
+            .register_function(b"sol_memcpy_", sol_memcpy_)
+            .unwrap();
+
+        loader
+            .register_function(b"sol_memset_", sol_memset_)
+            .unwrap();
+
+        loader
+            .register_function(b"sol_memcmp_", sol_memcmp_)
+            .unwrap();
+
         // program.program
         println!("program: {}", program.id.to_base58());
 
@@ -1437,6 +1526,7 @@ impl VirtualMachine {
             input_len: parameter_bytes.len(),
             refs: Rc::new(RefCell::new(&mut refs)),
             heap: heap.as_ptr(),
+            heap_size: heap.len(),
             remaining: 1000000,
         };
 
@@ -1544,13 +1634,12 @@ impl VirtualMachine {
             }
 
             let mut prev_offset = 0;
-            let return_len = LittleEndian::read_u32(&data[4..]) as usize;
-            let return_offset = LittleEndian::read_u32(&data[8..]) as usize;
+            // The offset of the last chunk and the head of the free list, or 0 if the free list
+            // has not been built yet
+            let heap_last = LittleEndian::read_u32(&data[4..]) as usize;
+            let heap_free = LittleEndian::read_u32(&data[8..]) as usize;
             let mut offset = LittleEndian::read_u32(&data[12..]) as usize;
-
-            // The return_offset/len fields are no longer used (we should remove them at some point)
-            assert_eq!(return_len, 0);
-            assert_eq!(return_offset, 0);
+            let mut free_chunks = HashSet::new();
 
             println!(
                 "static: length:{:x} {}",
@@ -1570,6 +1659,8 @@ impl VirtualMachine {
 
                 if allocate == 1 {
                     count += 1;
+                } else if next != 0 {
+                    free_chunks.insert(offset);
                 }
 
                 println!(
@@ -1589,6 +1680,10 @@ impl VirtualMachine {
                     assert_eq!(length, 0);
                     assert_eq!(allocate, 0);
 
+                    if heap_last != 0 {
+                        assert_eq!(heap_last, offset);
+                    }
+
                     break;
                 }
 
@@ -1598,6 +1693,25 @@ impl VirtualMachine {
                 offset = next;
             }
 
+            if heap_last != 0 {
+                // every free chunk is on the free list exactly once
+                let mut free = heap_free;
+                let mut prev_free = 0;
+
+                while free != 0 {
+                    assert!(free_chunks.remove(&free));
+                    assert_eq!(
+                        LittleEndian::read_u32(&data[free + 16 + 4..]) as usize,
+                        prev_free
+                    );
+
+                    prev_free = free;
+                    free = LittleEndian::read_u32(&data[free + 16..]) as usize;
+                }
+
+                assert!(free_chunks.is_empty());
+            }
+
             count
         } else {
             0
@@ -63,6 +63,67 @@ fn lamports() {
     );
 }
 
+#[test]
+fn many_accounts() {
+    let mut vm = build_solidity(
+        r#"
+        import 'solana';
+        contract c {
+            function test(address needle) public view returns (uint32, uint64) {
+                return (tx.accounts.length, needle.balance);
+            }
+        }"#,
+    );
+
+    let data_account = vm.initialize_data_account();
+    vm.function("new")
+        .accounts(vec![("dataAccount", data_account)])
+        .call();
+
+    let mut metas = Vec::new();
+
+    for lamports in 0..20 {
+        let acc = account_new();
+        vm.account_data.insert(
+            acc,
+            AccountState {
+                data: vec![],
+                owner: None,
+                lamports,
+            },
+        );
+
+        metas.push(AccountMeta {
+            pubkey: Pubkey(acc),
+            is_writable: false,
+            is_signer: false,
+        });
+    }
+
+    // accounts past the tenth are not dropped
+    let returns = vm
+        .function("test")
+        .arguments(&[BorshToken::Address(metas[15].pubkey.0)])
+        .accounts(vec![("dataAccount", data_account)])
+        .remaining_accounts(&metas)
+        .call()
+        .unwrap();
+
+    assert_eq!(
+        returns,
+        BorshToken::Tuple(vec![
+            BorshToken::Uint {
+                width: 32,
+                value: BigInt::from(21u8),
+            },
+            BorshToken::Uint {
+                width: 64,
+                value: BigInt::from(15u8),
+            },
+        ])
+    );
+}
+
 #[test]
 fn owner() {
     let mut vm = build_solidity(
@@ -2297,3 +2297,57 @@ contract MyTest {
         }
     );
 }
+
+#[test]
+fn concat_and_push_capacity() {
+    let src = r#"
+contract MyTest {
+    function test(string a, string b) public pure returns (string, uint32[]) {
+        string s = a + " " + b + "!" + a;
+        uint32[] x;
+
+        for (uint32 i = 0; i < 20; i++) {
+            x.push(uint32(x.length));
+        }
+
+        x.pop();
+        x.pop();
+        x.push(100);
+
+        return (s, x);
+    }
+}
+    "#;
+
+    let mut vm = build_solidity(src);
+    let data_account = vm.initialize_data_account();
+    vm.function("new")
+        .accounts(vec![("dataAccount", data_account)])
+        .call();
+
+    let ret = vm
+        .function("test")
+        .arguments(&[
+            BorshToken::String("hello".to_string()),
+            BorshToken::String("world".to_string()),
+        ])
+        .call()
+        .unwrap()
+        .unwrap_tuple();
+
+    let x = (0..18u32)
+        .chain([100])
+        .map(|value| BorshToken::Uint {
+            width: 32,
+            value: BigInt::from(value),
+        })
+        .collect();
+
+    assert_eq!(
+        ret,
+        vec![
+            BorshToken::String("hello world!hello".to_string()),
+            BorshToken::Array(x),
+        ]
+    );
+}
@@ -348,3 +348,72 @@ fn out_of_bounds_string_write() {
         .call();
     let _ = vm.function("testStringOut").call();
 }
+
+#[test]
+fn mulmod_addmod() {
+    let mut vm = build_solidity(
+        r#"
+        contract c {
+            function test(uint256 x, uint256 y, uint256 k) public pure returns (uint256, uint256) {
+                return (mulmod(x, y, k), addmod(x, y, k));
+            }
+        }"#,
+    );
+
+    let data_account = vm.initialize_data_account();
+
+    vm.function("new")
+        .accounts(vec![("dataAccount", data_account)])
+        .call();
+
+    let max = (BigInt::from(1) << 256) - 1;
+
+    let cases = [
+        (max.clone(), max.clone(), max.clone()),
+        (max.clone(), max.clone(), max.clone() - 1),
+        (max.clone(), BigInt::from(2), BigInt::from(7)),
+        (max.clone() - 5, max.clone() - 6, max.clone() - 5),
+        (
+            BigInt::from(3) << 200,
+            (BigInt::from(5) << 180) + 17,
+            (BigInt::from(1) << 255) + 19,
+        ),
+        (BigInt::from(10), BigInt::from(20), BigInt::from(1) << 128),
+    ];
+
+    for (x, y, k) in cases {
+        let returns = vm
+            .function("test")
+            .arguments(&[
+                BorshToken::Uint {
+                    width: 256,
+                    value: x.clone(),
+                },
+                BorshToken::Uint {
+                    width: 256,
+                    value: y.clone(),
+                },
+                BorshToken::Uint {
+                    width: 256,
+                    value: k.clone(),
+                },
+            ])
+            .call()
+            .unwrap()
+            .unwrap_tuple();
+
+        assert_eq!(
+            returns,
+            vec![
+                BorshToken::Uint {
+                    width: 256,
+                    value: (&x * &y) % &k,
+                },
+                BorshToken::Uint {
+                    width: 256,
+                    value: (&x + &y) % &k,
+                },
+            ]
+        );
+    }
+}
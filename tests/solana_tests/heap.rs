@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: Apache-2.0
+
+use crate::{BorshToken, VirtualMachineBuilder};
+use solang::codegen::Options;
+
+#[test]
+fn arena_heap() {
+    let mut vm = VirtualMachineBuilder::new(
+        r#"
+        contract heap {
+            function test(uint32 n) public pure returns (bytes, string) {
+                bytes b = new bytes(0);
+                string s = "";
+
+                for (uint32 i = 0; i < n; i++) {
+                    b.push(bytes1(uint8(i)));
+                    s = s + "ab";
+                }
+
+                b.pop();
+
+                return (b, s);
+            }
+        }"#,
+    )
+    .opts(Options {
+        arena_heap: true,
+        log_runtime_errors: true,
+        ..Default::default()
+    })
+    .build();
+
+    let data_account = vm.initialize_data_account();
+
+    vm.function("new")
+        .accounts(vec![("dataAccount", data_account)])
+        .call();
+
+    let returns = vm
+        .function("test")
+        .arguments(&[BorshToken::Uint {
+            width: 32,
+            value: 40.into(),
+        }])
+        .call()
+        .unwrap()
+        .unwrap_tuple();
+
+    assert_eq!(
+        returns,
+        vec![
+            BorshToken::Bytes((0..39).collect()),
+            BorshToken::String("ab".repeat(40)),
+        ]
+    );
+}
+
+#[test]
+fn heap_size() {
+    let src = r#"
+        contract heap {
+            function test(uint32 n) public pure returns (uint32) {
+                bytes b = new bytes(n);
+
+                b[n - 1] = 0x41;
+
+                return b.length;
+            }
+        }"#;
+
+    let arguments = [BorshToken::Uint {
+        width: 32,
+        value: 100_000.into(),
+    }];
+
+    // does not fit in the default heap
+    let mut vm = VirtualMachineBuilder::new(src).build();
+
+    let data_account = vm.initialize_data_account();
+
+    vm.function("new")
+        .accounts(vec![("dataAccount", data_account)])
+        .call();
+
+    vm.function("test").arguments(&arguments).must_fail();
+
+    assert!(vm.logs.contains("out of heap memory"));
+
+    for arena_heap in [false, true] {
+        let mut vm = VirtualMachineBuilder::new(src)
+            .opts(Options {
+                arena_heap,
+                heap_size: 128 * 1024,
+                log_runtime_errors: true,
+                ..Default::default()
+            })
+            .build();
+
+        let data_account = vm.initialize_data_account();
+
+        vm.function("new")
+            .accounts(vec![("dataAccount", data_account)])
+            .call();
+
+        let returns = vm.function("test").arguments(&arguments).call().unwrap();
+
+        assert_eq!(
+            returns,
+            BorshToken::Uint {
+                width: 32,
+                value: 100_000.into(),
+            }
+        );
+    }
+}
+
+#[test]
+fn stdlib_profile() {
+    let src = r#"
+        contract heap {
+            function test(uint128 n) public pure returns (string) {
+                return "n is {}".format(n);
+            }
+        }"#;
+
+    for arena_heap in [false, true] {
+        let mut vm = VirtualMachineBuilder::new(src)
+            .opts(Options {
+                arena_heap,
+                stdlib_profile: true,
+                ..Default::default()
+            })
+            .build();
+
+        let data_account = vm.initialize_data_account();
+
+        vm.function("new")
+            .accounts(vec![("dataAccount", data_account)])
+            .call();
+
+        vm.logs.clear();
+
+        vm.function("test")
+            .arguments(&[BorshToken::Uint {
+                width: 128,
+                value: 10u128.pow(20).into(),
+            }])
+            .call()
+            .unwrap();
+
+        // the helper number comes first, then the number of calls, the amount and the loop
+        // iterations; malloc is helper 0, and 10**20 is formatted once, which is 21 digits
+        // and takes one division by 10**19
+        assert!(vm
+            .logs
+            .contains("stdlib profile: helper, calls, amount, iterations"));
+        assert!(vm.logs.contains("0x0, 0x"));
+        assert!(vm.logs.contains("0x5, 0x1, 0x15, 0x1, 0x0"));
+        assert!(vm
+            .logs
+            .contains("heap: high water, allocations, bytes, free chunks, largest free"));
+    }
+
+    // the normal stdlib does not log anything
+    let mut vm = VirtualMachineBuilder::new(src).build();
+
+    let data_account = vm.initialize_data_account();
+
+    vm.function("new")
+        .accounts(vec![("dataAccount", data_account)])
+        .call();
+
+    assert!(!vm.logs.contains("stdlib profile"));
+}
@@ -18,6 +18,7 @@ mod destructure;
 mod events;
 mod expressions;
 mod hash;
+mod heap;
 mod mappings;
 mod math;
 mod metas;
@@ -68,10 +68,64 @@ fn run_test(path: &Path) {
     run_test_with_opts(
         &program,
         &calls,
-        [Options::default(), NO_OPTIMIZATIONS.clone()],
+        [
+            Options::default(),
+            NO_OPTIMIZATIONS.clone(),
+            Options {
+                min_size: true,
+                ..Default::default()
+            },
+        ],
     );
 }
 
+#[test]
+fn min_size() {
+    let src = r#"
+        contract c {
+            function test(uint256 a, uint64 b) public pure returns (string) {
+                return "{} {}".format(a / b, a % b);
+            }
+        }"#;
+
+    let code_size = |min_size| {
+        let mut vm = VirtualMachineBuilder::new(src)
+            .opts(Options {
+                min_size,
+                log_runtime_errors: true,
+                ..Default::default()
+            })
+            .build();
+
+        let data_account = vm.initialize_data_account();
+
+        vm.function("new")
+            .accounts(vec![("dataAccount", data_account)])
+            .call();
+
+        let returns = vm
+            .function("test")
+            .arguments(&[
+                BorshToken::Uint {
+                    width: 256,
+                    value: 1_000_000_007.into(),
+                },
+                BorshToken::Uint {
+                    width: 64,
+                    value: 1000.into(),
+                },
+            ])
+            .call()
+            .unwrap();
+
+        assert_eq!(returns, BorshToken::String("1000000 7".to_string()));
+
+        vm.account_data[&vm.programs[0].id].data.len()
+    };
+
+    assert!(code_size(true) < code_size(false));
+}
+
 fn run_test_with_opts<T: IntoIterator<Item = Options>>(program: &str, calls: &Calls, opts: T) {
     let mut results_prev: Option<Vec<Result<Option<BorshToken>, u64>>> = None;
 
@@ -1,6 +1,6 @@
 // SPDX-License-Identifier: Apache-2.0
 
-use crate::{build_solidity, BorshToken};
+use crate::{build_solidity, BorshToken, Pubkey};
 use num_bigint::BigInt;
 use num_traits::{One, Zero};
 
@@ -510,6 +510,121 @@ fn bytes_empty_pop() {
         .call();
 }
 
+#[test]
+fn bytes_grow_account() {
+    let mut vm = build_solidity(
+        r#"
+        contract c {
+            bytes bs;
+
+            function set(uint32 len) public {
+                bs = new bytes(len);
+                bs[len - 1] = 0x41;
+            }
+
+            function last() public view returns (byte) {
+                return bs[bs.length - 1];
+            }
+        }"#,
+    );
+
+    let data_account = vm.initialize_data_account();
+    vm.function("new")
+        .accounts(vec![("dataAccount", data_account)])
+        .call();
+
+    assert_eq!(vm.account_data[&data_account].data.len(), 4096);
+
+    // enough lamports to be rent exempt when the account has grown
+    vm.account_data.get_mut(&data_account).unwrap().lamports = rent_exempt_minimum(30000);
+
+    // the account grows to fit
+    vm.function("set")
+        .arguments(&[BorshToken::Uint {
+            width: 32,
+            value: BigInt::from(6000u32),
+        }])
+        .accounts(vec![("dataAccount", data_account)])
+        .call();
+
+    let len = vm.account_data[&data_account].data.len();
+
+    assert!(len > 6000 && len < 6100);
+
+    let returns = vm
+        .function("last")
+        .accounts(vec![("dataAccount", data_account)])
+        .call()
+        .unwrap();
+
+    assert_eq!(returns, BorshToken::uint8_fixed_array(vec!(0x41)));
+
+    assert_eq!(vm.validate_account_data_heap(&Pubkey(data_account)), 1);
+
+    // but only by MAX_PERMITTED_DATA_INCREASE in one instruction
+    vm.function("set")
+        .arguments(&[BorshToken::Uint {
+            width: 32,
+            value: BigInt::from(20000u32),
+        }])
+        .accounts(vec![("dataAccount", data_account)])
+        .must_fail();
+
+    assert_eq!(vm.account_data[&data_account].data.len(), len);
+}
+
+/// Minimum balance for an account to be rent exempt with the default rent
+fn rent_exempt_minimum(data_len: u64) -> u64 {
+    (128 + data_len) * 3480 * 2
+}
+
+#[test]
+fn bytes_grow_account_rent() {
+    let mut vm = build_solidity(
+        r#"
+        contract c {
+            bytes bs;
+
+            function set(uint32 len) public {
+                bs = new bytes(len);
+            }
+        }"#,
+    );
+
+    let data_account = vm.initialize_data_account();
+    vm.function("new")
+        .accounts(vec![("dataAccount", data_account)])
+        .call();
+
+    let args = &[BorshToken::Uint {
+        width: 32,
+        value: BigInt::from(6000u32),
+    }];
+
+    // the account holds enough for its current length, but would not be rent exempt once grown
+    vm.account_data.get_mut(&data_account).unwrap().lamports = rent_exempt_minimum(4096);
+
+    vm.function("set")
+        .arguments(args)
+        .accounts(vec![("dataAccount", data_account)])
+        .must_fail();
+
+    assert_eq!(vm.account_data[&data_account].data.len(), 4096);
+
+    // once it is funded, it grows
+    vm.account_data.get_mut(&data_account).unwrap().lamports = rent_exempt_minimum(6100);
+
+    vm.function("set")
+        .arguments(args)
+        .accounts(vec![("dataAccount", data_account)])
+        .call();
+
+    let len = vm.account_data[&data_account].data.len() as u64;
+
+    assert!(len > 6000 && vm.account_data[&data_account].lamports >= rent_exempt_minimum(len));
+    assert_eq!(vm.validate_account_data_heap(&Pubkey(data_account)), 1);
+}
+
 #[test]
 fn simple_struct() {
     let mut vm = build_solidity(
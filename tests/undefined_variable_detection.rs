@@ -22,6 +22,11 @@ fn parse_and_codegen(src: &'static str) -> Namespace {
         log_api_return_codes: false,
         log_runtime_errors: false,
         log_prints: true,
+        arena_heap: false,
+        heap_size: 32 * 1024,
+        stdlib_profile: false,
+        min_size: false,
+        wasm_bulk_memory: false,
         #[cfg(feature = "wasm_opt")]
         wasm_opt: None,
     };